@@ -5,20 +5,163 @@
 #include <cstdlib>
 #include <ctime>
 #include <sstream>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <fstream>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
+#include <list>
+#include <unordered_map>
+#include <unordered_set>
+#include <algorithm>
+#include <filesystem>
+#ifndef _WIN32
+#include <cerrno>
+#include <csignal>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
 
 using namespace std;
 
+// Tracing: build with -DSOLITAIRE_TRACE to record every TRACE_SCOPE into a per-thread
+// ring buffer and write them as Chrome/Perfetto trace JSON (chrome://tracing,
+// ui.perfetto.dev) when the program ends. Without the flag TRACE_SCOPE expands to
+// nothing. The output file is $SOLITAIRE_TRACE_FILE, or solitaire_trace.json.
+#ifdef SOLITAIRE_TRACE
+
+struct TraceEvent {
+    const char* name;
+    uint64_t start;       // microseconds since the program started
+    uint64_t duration;
+};
+
+// Events of one thread; once full, the oldest events are overwritten
+struct TraceBuffer {
+    static const uint64_t CAPACITY = 1 << 16;
+    TraceEvent events[CAPACITY];
+    uint64_t count = 0;
+    int threadId = 0;
+};
+
+class Tracer {
+    mutex lock;
+    vector<unique_ptr<TraceBuffer>> buffers;   // kept after their threads exit
+    chrono::steady_clock::time_point origin = chrono::steady_clock::now();
+
+public:
+    static Tracer& instance() {
+        static Tracer tracer;
+        return tracer;
+    }
+
+    uint64_t now() const {
+        return (uint64_t)chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - origin).count();
+    }
+
+    // The calling thread's buffer, registered on first use
+    TraceBuffer& local() {
+        static thread_local TraceBuffer* buffer = nullptr;
+        if (buffer == nullptr) {
+            lock_guard<mutex> guard(lock);
+            buffers.emplace_back(new TraceBuffer());
+            buffer = buffers.back().get();
+            buffer->threadId = (int)buffers.size();
+        }
+        return *buffer;
+    }
+
+    // Write all recorded events; call once the worker threads have finished
+    void write() {
+        const char* path = getenv("SOLITAIRE_TRACE_FILE");
+        ofstream out(path ? path : "solitaire_trace.json");
+        lock_guard<mutex> guard(lock);
+        out << "{\"traceEvents\":[";
+        bool first = true;
+        for (const unique_ptr<TraceBuffer>& buffer : buffers) {
+            uint64_t begin = buffer->count > TraceBuffer::CAPACITY ? buffer->count - TraceBuffer::CAPACITY : 0;
+            for (uint64_t i = begin; i < buffer->count; ++i) {
+                const TraceEvent& event = buffer->events[i % TraceBuffer::CAPACITY];
+                out << (first ? "\n" : ",\n") << "{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":"
+                    << buffer->threadId << ",\"ts\":" << event.start << ",\"dur\":" << event.duration << "}";
+                first = false;
+            }
+        }
+        out << "\n]}\n";
+    }
+};
+
+// Records the time between its construction and destruction
+class TraceScope {
+    const char* name;
+    uint64_t start;
+public:
+    explicit TraceScope(const char* scopeName) : name(scopeName), start(Tracer::instance().now()) {}
+
+    ~TraceScope() {
+        Tracer& tracer = Tracer::instance();
+        TraceBuffer& buffer = tracer.local();
+        TraceEvent& event = buffer.events[buffer.count++ % TraceBuffer::CAPACITY];
+        event.name = name;
+        event.start = start;
+        event.duration = tracer.now() - start;
+    }
+};
+
+#define TRACE_JOIN2(a, b) a##b
+#define TRACE_JOIN(a, b) TRACE_JOIN2(a, b)
+#define TRACE_SCOPE(name) TraceScope TRACE_JOIN(traceScope, __LINE__)(name)
+#define TRACE_WRITE() Tracer::instance().write()
+
+#else
+
+#define TRACE_SCOPE(name)
+#define TRACE_WRITE()
+
+#endif
+
+// Suit order used by the deck and by the dense card id
+constexpr char SUITS[4] = { 'H', 'S', 'C', 'D' };
+
+// Index of a suit character in SUITS, or 4 if it is not a suit
+constexpr int suitIndex(char suit) {
+    for (int i = 0; i < 4; ++i) {
+        if (SUITS[i] == suit) return i;
+    }
+    return 4;
+}
+
+// Dense card id: suit index * 13 + (rank - 1), 0-51; NO_CARD for anything else
+constexpr unsigned char NO_CARD = 52;
+
+constexpr unsigned char cardId(int rank, char suit) {
+    return rank >= 1 && rank <= 13 && suitIndex(suit) < 4 ? (unsigned char)(suitIndex(suit) * 13 + rank - 1) : NO_CARD;
+}
+
 class Card {
 public:
     int rank;
     char suit;
     bool isFaceUp;
+    unsigned char id;    // cardId(rank, suit), for the rule tables
 
     // Default constructor
     Card() {
         rank = 0;
         suit = '0';
         isFaceUp = false;  
+        id = NO_CARD;
     }
 
     // Parameterized constructor
@@ -26,6 +169,7 @@ public:
         rank = r;
         suit = s;
         isFaceUp = faceUp;
+        id = cardId(r, s);
     }
 
     // Print card details, showing face-down cards as "X" if it's face-down
@@ -39,6 +183,51 @@ public:
     }
 };
 
+// Pack a card into one byte: bits 0-5 hold the card id, bit 6 is the face-up flag
+unsigned char encodeCard(const Card& card) {
+    unsigned char code = card.id;
+    if (card.isFaceUp) code |= 0x40;
+    return code;
+}
+
+// Klondike rules by card id, built at compile time. Row NO_CARD is all zero, so a
+// missing card never passes a check.
+struct CardTables {
+    unsigned char rank[NO_CARD + 1];
+    bool red[NO_CARD + 1];
+    uint64_t stacksOn[NO_CARD + 1];                 // bit j: may be placed on card j in the tableau
+    unsigned char foundationNext[NO_CARD + 1];      // card that may follow on a foundation
+};
+
+constexpr CardTables buildCardTables() {
+    CardTables tables = {};
+    for (int id = 0; id < NO_CARD; ++id) {
+        tables.rank[id] = (unsigned char)(id % 13 + 1);
+        tables.red[id] = SUITS[id / 13] == 'H' || SUITS[id / 13] == 'D';
+    }
+    tables.rank[NO_CARD] = 0;
+    for (int id = 0; id < NO_CARD; ++id) {
+        for (int onto = 0; onto < NO_CARD; ++onto) {
+            if (tables.rank[id] + 1 == tables.rank[onto] && tables.red[id] != tables.red[onto]) {
+                tables.stacksOn[id] |= 1ULL << onto;
+            }
+        }
+        tables.foundationNext[id] = tables.rank[id] < 13 ? (unsigned char)(id + 1) : NO_CARD;
+    }
+    tables.foundationNext[NO_CARD] = NO_CARD;
+    return tables;
+}
+
+constexpr CardTables CARD_TABLES = buildCardTables();
+static_assert(CARD_TABLES.stacksOn[cardId(12, 'H')] == (1ULL << cardId(13, 'S') | 1ULL << cardId(13, 'C')), "red queen goes on a black king");
+static_assert(CARD_TABLES.foundationNext[cardId(13, 'D')] == NO_CARD, "nothing follows a king");
+
+// Unpack a card produced by encodeCard
+Card decodeCard(unsigned char code) {
+    int id = code & 0x3F;
+    return Card(id % 13 + 1, SUITS[id / 13], (code & 0x40) != 0);
+}
+
 class Node {
 public:
     Card val;
@@ -65,49 +254,100 @@ struct Move {
         ResetStockFromWaste
     };
 
-    MoveType moveType;
+    MoveType moveType = DrawStockToWaste;
 
     // Common data
-    int srcColumn;
-    int destColumn;
-    int foundationIndex;
-    int numOfCards;
+    int srcColumn = 0;
+    int destColumn = 0;
+    int foundationIndex = 0;
+    int numOfCards = 0;
 
     // For storing a moved card
     Card movedCard;
 
     // For tracking if a card was flipped after the move
-    bool flippedCard;
-    int flippedColumn;
+    bool flippedCard = false;
+    int flippedColumn = 0;
+
+    // Pack the move into 32 bits:
+    //   bits 0-2 type, 3-5 source column, 6-8 destination column, 9-10 foundation,
+    //   11-15 number of cards, 16 flipped flag, 17-23 moved card (encodeCard, 0x7F if none)
+    uint32_t encode() const {
+        uint32_t card = movedCard.rank == 0 ? 0x7F : encodeCard(movedCard);
+        return (uint32_t)moveType
+            | (uint32_t)srcColumn << 3
+            | (uint32_t)destColumn << 6
+            | (uint32_t)foundationIndex << 9
+            | (uint32_t)numOfCards << 11
+            | (uint32_t)(flippedCard ? 1 : 0) << 16
+            | card << 17;
+    }
+
+    // Unpack a move produced by encode
+    static Move decode(uint32_t word) {
+        Move move;
+        move.moveType = (MoveType)(word & 0x7);
+        move.srcColumn = (word >> 3) & 0x7;
+        move.destColumn = (word >> 6) & 0x7;
+        move.foundationIndex = (word >> 9) & 0x3;
+        move.numOfCards = (word >> 11) & 0x1F;
+        move.flippedCard = ((word >> 16) & 0x1) != 0;
+        move.flippedColumn = move.srcColumn;
+        unsigned char card = (word >> 17) & 0x7F;
+        if (card != 0x7F) move.movedCard = decodeCard(card);
+        return move;
+    }
 };
 
+// Undo history: packed 32-bit moves in one growable array
 class MoveStack {
 private:
-    struct MoveNode {
-        Move val;
-        MoveNode* next;
-    };
-    MoveNode* top;
+    uint32_t* data;
     int size;
+    int capacity;
+
+    // Grow the buffer geometrically so pushes are amortized O(1)
+    void grow() {
+        int newCapacity = capacity == 0 ? 64 : capacity * 2;
+        uint32_t* newData = new uint32_t[newCapacity];
+        if (size > 0) memcpy(newData, data, size * sizeof(uint32_t));
+        delete[] data;
+        data = newData;
+        capacity = newCapacity;
+    }
+
 public:
-    MoveStack() : top(nullptr), size(0) {}
+    MoveStack() : data(nullptr), size(0), capacity(0) {}
+
+    // Copy constructor, clones the history in the same order
+    MoveStack(const MoveStack& other) : data(nullptr), size(0), capacity(0) {
+        *this = other;
+    }
+
+    // Copy assignment
+    MoveStack& operator=(const MoveStack& other) {
+        if (this != &other) {
+            if (capacity < other.size) {
+                delete[] data;
+                data = new uint32_t[other.capacity];
+                capacity = other.capacity;
+            }
+            if (other.size > 0) memcpy(data, other.data, other.size * sizeof(uint32_t));
+            size = other.size;
+        }
+        return *this;
+    }
 
     void pushMove(const Move& move) {
-        MoveNode* newNode = new MoveNode{ move, top };
-        top = newNode;
-        size++;
+        if (size == capacity) grow();
+        data[size++] = move.encode();
     }
 
     Move popMove() {
         if (isempty()) {
             throw std::runtime_error("MoveStack is empty");
         }
-        MoveNode* node = top;
-        Move move = node->val;
-        top = top->next;
-        delete node;
-        size--;
-        return move;
+        return Move::decode(data[--size]);
     }
 
     bool isempty() const {
@@ -118,34 +358,52 @@ public:
         return size;
     }
 
+    // Remove every move from the history, keeping the buffer for reuse
+    void clear() {
+        size = 0;
+    }
+
+    // Packed moves, oldest first
+    const uint32_t* rawData() const {
+        return data;
+    }
+
+    // Replace the history with count packed moves, oldest first
+    void assign(const uint32_t* moves, int count) {
+        size = 0;
+        while (capacity < count) grow();
+        if (count > 0) memcpy(data, moves, count * sizeof(uint32_t));
+        size = count;
+    }
+
     ~MoveStack() {
-        while (top != nullptr) {
-            MoveNode* temp = top;
-            top = top->next;
-            delete temp;
-        }
+        delete[] data;
     }
 };
 
 // Only allow moving a King (rank 13)
-bool canMoveToEmptyTableau(const Card& card) {
-    return card.rank == 13;
+inline bool canMoveToEmptyTableau(const Card& card) {
+    return CARD_TABLES.rank[card.id] == 13;
 }
 
-// check if suit colors are opposite
-bool isOppositeColor(char suit1, char suit2) {
-    if ((suit1 == 'H' || suit1 == 'D') && (suit2 == 'S' || suit2 == 'C')) {
-        return true;
-    }
-    if ((suit1 == 'S' || suit1 == 'C') && (suit2 == 'H' || suit2 == 'D')) {
-        return true;
-    }
-    return false;
+// One rank lower and the opposite color: card may go on onto in the tableau
+inline bool canStackOn(const Card& card, const Card& onto) {
+    return (CARD_TABLES.stacksOn[card.id] >> onto.id) & 1;
 }
 
-// Function to check if one card's rank is exactly one less than another
-bool isonesmaller(Card card1, Card card2) {
-    return (card1.rank == card2.rank - 1);
+// Only an Ace starts a foundation
+inline bool canStartFoundation(const Card& card) {
+    return CARD_TABLES.rank[card.id] == 1;
+}
+
+// Same suit and one rank higher than the foundation's top card
+inline bool canGoOnFoundation(const Card& card, const Card& top) {
+    return CARD_TABLES.foundationNext[top.id] == card.id && card.id != NO_CARD;
+}
+
+// check if suit colors are opposite
+bool isOppositeColor(char suit1, char suit2) {
+    return CARD_TABLES.red[cardId(1, suit1)] != CARD_TABLES.red[cardId(1, suit2)];
 }
 
 // Doubly Linked List for the tableau columns
@@ -163,11 +421,37 @@ public:
         size = 0;
     }
 
+    // Copy constructor, clones every node so the copies never share memory
+    doublylinkedlist(const doublylinkedlist& other) {
+        this->head = nullptr;
+        this->tail = nullptr;
+        size = 0;
+        for (Node* current = other.head; current != nullptr; current = current->next) {
+            addCardToEnd(current->val);
+        }
+    }
+
+    // Copy assignment
+    doublylinkedlist& operator=(const doublylinkedlist& other) {
+        if (this != &other) {
+            clear();
+            for (Node* current = other.head; current != nullptr; current = current->next) {
+                addCardToEnd(current->val);
+            }
+        }
+        return *this;
+    }
+
     // Getter for head Node
     Node* getHead() const {
         return head;
     }
 
+    // Getter for tail Node (the top card of a tableau column)
+    Node* getTail() const {
+        return tail;
+    }
+
     // to add card to end of tableau/column
     void addCardToEnd(Card cardVal) {
         Node* newNode = new Node(cardVal);
@@ -321,8 +605,8 @@ public:
         return size;
     }
 
-    // Destructor to clean up memory
-    ~doublylinkedlist() {
+    // Delete every node and leave the list empty
+    void clear() {
         Node* current = this->head;
         while (current != nullptr) {
             Node* temp = current->next;
@@ -332,6 +616,11 @@ public:
         this->head = this->tail = nullptr;
         this->size = 0;
     }
+
+    // Destructor to clean up memory
+    ~doublylinkedlist() {
+        clear();
+    }
 };
 
 // Stack class for foundations, stockpile, and wastepile
@@ -347,6 +636,23 @@ public:
         top = nullptr;
         size = 0;
     }
+
+    // Copy constructor, clones every node keeping top-to-bottom order
+    stack(const stack& other) {
+        top = nullptr;
+        size = 0;
+        copyFrom(other);
+    }
+
+    // Copy assignment
+    stack& operator=(const stack& other) {
+        if (this != &other) {
+            clear();
+            copyFrom(other);
+        }
+        return *this;
+    }
+
     // push a node to the stack
     void pushNode(Node* cardNode) {
         if (cardNode == nullptr) return;
@@ -389,8 +695,8 @@ public:
         return size;
     }
 
-    // Destructor to clean up memory
-    ~stack() {
+    // Delete every node and leave the stack empty
+    void clear() {
         Node* current = this->top;
         while (current != nullptr) {
             Node* temp = current->next;
@@ -400,63 +706,502 @@ public:
         this->top = nullptr;
         this->size = 0;
     }
+
+    // Destructor to clean up memory
+    ~stack() {
+        clear();
+    }
+
+private:
+    // Append clones of other's nodes below the current ones
+    void copyFrom(const stack& other) {
+        Node* last = nullptr;
+        for (Node* current = other.top; current != nullptr; current = current->next) {
+            Node* newNode = new Node(current->val);
+            if (last == nullptr) {
+                top = newNode;
+            }
+            else {
+                last->next = newNode;
+            }
+            last = newNode;
+        }
+        size = other.size;
+    }
+};
+
+// Flat, fixed-size copy of a game position. It holds no pointers, so it can be
+// memcpy'd, hashed or written to disk as-is. Piles are stored bottom to top.
+struct GameSnapshot {
+    unsigned char tableauSize[7];
+    unsigned char tableau[7][19];      // at most 6 face-down cards plus a King-to-Ace run
+    unsigned char foundationSize[4];
+    unsigned char foundation[4][13];
+    unsigned char stockSize;
+    unsigned char stock[24];
+    unsigned char wasteSize;
+    unsigned char waste[24];
+};
+
+// Upper bound on the number of legal moves in any position
+const int MAX_MOVES = 128;
+
+// 256-bit unsigned integer holding the permutation rank of a deal. There are
+// 52! < 2^226 deals, so every deal has a unique index below DEAL_COUNT and
+// ranges of indices can be split between workers like ranges of seeds.
+struct DealIndex {
+    uint64_t words[4] = { 0, 0, 0, 0 };   // least significant first
+
+    // this = this * factor + addend, for factor and addend below 2^32
+    void multiplyAdd(uint32_t factor, uint32_t addend) {
+        uint64_t carry = addend;
+        for (int i = 0; i < 4; ++i) {
+            // 32-bit halves keep this portable without a 128-bit type
+            uint64_t low = (words[i] & 0xFFFFFFFFULL) * factor + carry;
+            uint64_t high = (words[i] >> 32) * factor + (low >> 32);
+            words[i] = (low & 0xFFFFFFFFULL) | (high << 32);
+            carry = high >> 32;
+        }
+    }
+
+    // this /= divisor; returns the remainder
+    uint32_t divide(uint32_t divisor) {
+        uint64_t remainder = 0;
+        for (int i = 3; i >= 0; --i) {
+            uint64_t high = (remainder << 32) | (words[i] >> 32);
+            remainder = high % divisor;
+            uint64_t low = (remainder << 32) | (words[i] & 0xFFFFFFFFULL);
+            remainder = low % divisor;
+            words[i] = ((high / divisor) << 32) | (low / divisor);
+        }
+        return (uint32_t)remainder;
+    }
+
+    // this += value
+    void add(uint64_t value) {
+        for (int i = 0; i < 4 && value != 0; ++i) {
+            words[i] += value;
+            value = words[i] < value ? 1 : 0;
+        }
+    }
+
+    bool operator<(const DealIndex& other) const {
+        for (int i = 3; i >= 0; --i) {
+            if (words[i] != other.words[i]) return words[i] < other.words[i];
+        }
+        return false;
+    }
+
+    // 57 hex digits, most significant first
+    string toHex() const {
+        static const char DIGITS[] = "0123456789abcdef";
+        string hex(57, '0');
+        for (int digit = 0; digit < 57; ++digit) {
+            hex[56 - digit] = DIGITS[(words[digit / 16] >> (digit % 16 * 4)) & 0xF];
+        }
+        return hex;
+    }
+
+    // Parse up to 64 hex digits; false on any other character
+    static bool fromHex(const string& hex, DealIndex& index) {
+        index = DealIndex();
+        if (hex.empty() || hex.size() > 64) return false;
+        for (char c : hex) {
+            int value = c >= '0' && c <= '9' ? c - '0'
+                : c >= 'a' && c <= 'f' ? c - 'a' + 10
+                : c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+            if (value < 0) return false;
+            index.multiplyAdd(16, (uint32_t)value);
+        }
+        return true;
+    }
+};
+
+// 52!, one past the largest deal index
+DealIndex dealCount() {
+    DealIndex count;
+    count.add(1);
+    for (uint32_t k = 2; k <= 52; ++k) count.multiplyAdd(k, 0);
+    return count;
+}
+
+const DealIndex DEAL_COUNT = dealCount();
+
+// Lehmer code of a deal (card ids 0-51 in dealing order): digit i counts the cards
+// after position i that are smaller, and the digits form a mixed-radix number
+DealIndex rankDeal(const unsigned char order[52]) {
+    DealIndex index;
+    for (int i = 0; i < 52; ++i) {
+        uint32_t smaller = 0;
+        for (int j = i + 1; j < 52; ++j) {
+            if (order[j] < order[i]) smaller++;
+        }
+        index.multiplyAdd(52 - i, smaller);
+    }
+    return index;
+}
+
+// Inverse of rankDeal; index must be below DEAL_COUNT
+void unrankDeal(DealIndex index, unsigned char order[52]) {
+    uint32_t digits[52];
+    for (int i = 51; i >= 0; --i) {
+        digits[i] = index.divide(52 - i);
+    }
+    unsigned char remaining[52];
+    for (int id = 0; id < 52; ++id) remaining[id] = (unsigned char)id;
+    for (int i = 0; i < 52; ++i) {
+        order[i] = remaining[digits[i]];
+        memmove(&remaining[digits[i]], &remaining[digits[i] + 1], 51 - i - digits[i]);
+    }
+}
+
+// Fixed header at the start of a save file
+struct SaveHeader {
+    char magic[4];
+    uint16_t version;
+    uint16_t reserved;
+    uint32_t historyCount;
 };
 
-// Game class to manage the overall game logic
+// Write a file by writing a temporary next to it and renaming it over the target,
+// so a crash leaves either the old file or the new one, never half of each
+bool writeFileAtomically(const string& path, const char* data, size_t size) {
+    string tempPath = path + ".tmp";
+    {
+        ofstream out(tempPath, ios::binary | ios::trunc);
+        if (!out.write(data, size)) return false;
+    }
+    if (rename(tempPath.c_str(), path.c_str()) != 0) {
+        // Windows will not rename over an existing file
+        remove(path.c_str());
+        if (rename(tempPath.c_str(), path.c_str()) != 0) return false;
+    }
+    return true;
+}
+
+// Read a whole file into memory with one read
+bool readWholeFile(const string& path, vector<char>& buffer) {
+    ifstream in(path, ios::binary | ios::ate);
+    if (!in) return false;
+    streamsize fileSize = in.tellg();
+    buffer.resize((size_t)fileSize);
+    in.seekg(0);
+    return fileSize == 0 || (bool)in.read(buffer.data(), fileSize);
+}
+
+const char SAVE_MAGIC[4] = { 'S', 'O', 'L', 'S' };
+const uint16_t SAVE_VERSION = 2;   // version 1 files have no deal order
+
+// Game class to manage the overall game logic.
+// Every pile owns deep-copyable storage, so a game can be copied to fork a position.
 class game {
     doublylinkedlist tableau[7];   // Array of 7 linked lists representing tableau columns
     stack foundation[4];           // Array of 4 stacks representing the foundation piles
     stack stockpile;               // Stack for the stockpile
     stack wastepile;               // Stack for the wastepile
     MoveStack commandStack;            // Stack to store commands for undo operations
+    unsigned char dealOrder[52];   // card ids in dealing order; dealOrder[0] == 0xFF if unknown
+    bool quiet;                    // suppress move messages (batch runs, search)
+
+    // Stream for move messages: cout, or a stream that drops everything when quiet.
+    // The silent stream is per thread so parallel games never share stream state.
+    ostream& msg() const {
+        static thread_local ostream silent(nullptr);
+        return quiet ? silent : cout;
+    }
 
 public:
     // Constructor to initialize and start the game
-    game() {
-        initializeDeck();
+    game() : quiet(false) {
+        initializeDeck((uint32_t)time(0));
+    }
+
+    // Deal a reproducible game from a seed
+    explicit game(uint32_t seed) : quiet(false) {
+        initializeDeck(seed);
+    }
+
+    // Deal the game with the given deal index (see rankDeal)
+    explicit game(const DealIndex& index) : quiet(false) {
+        unsigned char order[52];
+        unrankDeal(index, order);
+        doublylinkedlist deck;
+        for (int i = 0; i < 52; ++i) {
+            deck.addCardToEnd(decodeCard(order[i]));
+        }
+        dealCards(deck);
+    }
+
+    // Index of the deal this game started from; false if unknown (older save file)
+    bool getDealIndex(DealIndex& index) const {
+        if (dealOrder[0] == 0xFF) return false;
+        index = rankDeal(dealOrder);
+        return true;
     }
 
-    void initializeDeck() {
+    void initializeDeck(uint32_t seed) {
         doublylinkedlist deck;
-        char suits[] = { 'H', 'S', 'C', 'D' };
-        for (char suit : suits) {
+        for (char suit : SUITS) {
             for (int rank = 1; rank <= 13; ++rank) {
                 deck.addCardToEnd(Card(rank, suit));
             }
         }
 
-        shuffleDeck(deck);
+        shuffleDeck(deck, seed);
         dealCards(deck);
     }
 
+    // Turn move messages on or off
+    void setQuiet(bool value) {
+        quiet = value;
+    }
+
+    // Number of moves in the undo history
+    int getMoveCount() const {
+        return commandStack.getsize();
+    }
+
+    // Total number of cards on the foundations
+    int foundationCount() const {
+        return foundation[0].getsize() + foundation[1].getsize() + foundation[2].getsize() + foundation[3].getsize();
+    }
+
+    // Whether every pile fits its GameSnapshot array. Always true in play; a
+    // corrupt history can break it while loadFromFile undoes it.
+    bool fitsSnapshot() const {
+        for (int i = 0; i < 7; ++i) {
+            if (tableau[i].getsize() > 19) return false;
+        }
+        for (int f = 0; f < 4; ++f) {
+            if (foundation[f].getsize() > 13) return false;
+        }
+        return stockpile.getsize() <= 24 && wastepile.getsize() <= 24;
+    }
+
+    // Write the current position into a flat snapshot (undo history is not included)
+    void saveSnapshot(GameSnapshot& snap) const {
+        for (int i = 0; i < 7; ++i) {
+            int n = 0;
+            for (Node* current = tableau[i].getHead(); current != nullptr && n < 19; current = current->next) {
+                snap.tableau[i][n++] = encodeCard(current->val);
+            }
+            snap.tableauSize[i] = (unsigned char)n;
+        }
+        for (int f = 0; f < 4; ++f) {
+            snap.foundationSize[f] = (unsigned char)foundation[f].getsize();
+            saveStack(foundation[f], snap.foundation[f]);
+        }
+        snap.stockSize = (unsigned char)stockpile.getsize();
+        saveStack(stockpile, snap.stock);
+        snap.wasteSize = (unsigned char)wastepile.getsize();
+        saveStack(wastepile, snap.waste);
+    }
+
+    // Replace the current position with a snapshot. The undo history is cleared
+    // because its moves belong to a different line of play.
+    void loadSnapshot(const GameSnapshot& snap) {
+        for (int i = 0; i < 7; ++i) {
+            tableau[i].clear();
+            for (int n = 0; n < snap.tableauSize[i]; ++n) {
+                tableau[i].addCardToEnd(decodeCard(snap.tableau[i][n]));
+            }
+        }
+        for (int f = 0; f < 4; ++f) {
+            loadStack(foundation[f], snap.foundation[f], snap.foundationSize[f]);
+        }
+        loadStack(stockpile, snap.stock, snap.stockSize);
+        loadStack(wastepile, snap.waste, snap.wasteSize);
+        commandStack.clear();
+    }
+
+    // Check that a snapshot read from outside describes a real deck:
+    // piles within their capacities and every card present exactly once
+    static bool isValidSnapshot(const GameSnapshot& snap) {
+        bool seen[52] = {};
+        int total = 0;
+        auto take = [&](const unsigned char* cards, int count, int capacity) {
+            if (count > capacity) return false;
+            for (int n = 0; n < count; ++n) {
+                int id = cards[n] & 0x3F;
+                if (id >= 52 || seen[id]) return false;
+                seen[id] = true;
+            }
+            total += count;
+            return true;
+        };
+        for (int i = 0; i < 7; ++i) {
+            if (!take(snap.tableau[i], snap.tableauSize[i], 19)) return false;
+        }
+        for (int f = 0; f < 4; ++f) {
+            if (!take(snap.foundation[f], snap.foundationSize[f], 13)) return false;
+        }
+        if (!take(snap.stock, snap.stockSize, 24) || !take(snap.waste, snap.wasteSize, 24)) return false;
+        return total == 52;
+    }
+
+    // Same cards in the same places. Face-up flags are compared on the tableau and
+    // foundations only: a rejected w2t can leave a stale flag on a stock card.
+    static bool sameSnapshot(const GameSnapshot& a, const GameSnapshot& b) {
+        auto same = [](const unsigned char* x, const unsigned char* y, int count, unsigned char mask) {
+            for (int n = 0; n < count; ++n) {
+                if ((x[n] & mask) != (y[n] & mask)) return false;
+            }
+            return true;
+        };
+        for (int i = 0; i < 7; ++i) {
+            if (a.tableauSize[i] != b.tableauSize[i] || !same(a.tableau[i], b.tableau[i], a.tableauSize[i], 0x7F)) return false;
+        }
+        for (int f = 0; f < 4; ++f) {
+            if (a.foundationSize[f] != b.foundationSize[f] || !same(a.foundation[f], b.foundation[f], a.foundationSize[f], 0x7F)) {
+                return false;
+            }
+        }
+        return a.stockSize == b.stockSize && same(a.stock, b.stock, a.stockSize, 0x3F)
+            && a.wasteSize == b.wasteSize && same(a.waste, b.waste, a.wasteSize, 0x3F);
+    }
+
+    // Save the position, deal and undo history to a binary file. Layout (native byte order):
+    //   SaveHeader | GameSnapshot | deal order (52 card ids) | uint32_t packed move x historyCount
+    // The file is written to a temporary name and renamed so a crash never leaves a torn save.
+    bool saveToFile(const string& path) const {
+        SaveHeader header;
+        memcpy(header.magic, SAVE_MAGIC, 4);
+        header.version = SAVE_VERSION;
+        header.reserved = 0;
+        header.historyCount = (uint32_t)commandStack.getsize();
+
+        const size_t historyOffset = sizeof(SaveHeader) + sizeof(GameSnapshot) + sizeof(dealOrder);
+        vector<char> buffer(historyOffset + header.historyCount * sizeof(uint32_t));
+        GameSnapshot snap;
+        saveSnapshot(snap);
+        memcpy(&buffer[0], &header, sizeof(SaveHeader));
+        memcpy(&buffer[sizeof(SaveHeader)], &snap, sizeof(GameSnapshot));
+        memcpy(&buffer[sizeof(SaveHeader) + sizeof(GameSnapshot)], dealOrder, sizeof(dealOrder));
+        if (header.historyCount > 0) {
+            memcpy(&buffer[historyOffset], commandStack.rawData(), header.historyCount * sizeof(uint32_t));
+        }
+        return writeFileAtomically(path, buffer.data(), buffer.size());
+    }
+
+    // Load a file written by saveToFile with a single read. Version 1 files load with
+    // an unknown deal. The current game is left untouched if the file is missing,
+    // truncated, from an unknown version, or holds a history that does not lead to
+    // its position.
+    bool loadFromFile(const string& path) {
+        ifstream in(path, ios::binary | ios::ate);
+        if (!in) return false;
+        streamsize fileSize = in.tellg();
+        if (fileSize < (streamsize)(sizeof(SaveHeader) + sizeof(GameSnapshot))) return false;
+        vector<char> buffer((size_t)fileSize);
+        in.seekg(0);
+        if (!in.read(buffer.data(), fileSize)) return false;
+
+        SaveHeader header;
+        memcpy(&header, &buffer[0], sizeof(SaveHeader));
+        if (memcmp(header.magic, SAVE_MAGIC, 4) != 0 || header.version < 1 || header.version > SAVE_VERSION) return false;
+        const size_t historyOffset = sizeof(SaveHeader) + sizeof(GameSnapshot) + (header.version >= 2 ? sizeof(dealOrder) : 0);
+        if ((size_t)fileSize != historyOffset + (size_t)header.historyCount * sizeof(uint32_t)) return false;
+
+        GameSnapshot snap;
+        memcpy(&snap, &buffer[sizeof(SaveHeader)], sizeof(GameSnapshot));
+        if (!isValidSnapshot(snap)) return false;
+
+        unsigned char order[52];
+        order[0] = 0xFF;
+        if (header.version >= 2) {
+            memcpy(order, &buffer[sizeof(SaveHeader) + sizeof(GameSnapshot)], sizeof(order));
+            bool seen[52] = {};
+            for (unsigned char id : order) {
+                if (id >= 52 || seen[id]) return false;
+                seen[id] = true;
+            }
+        }
+
+        vector<uint32_t> history(header.historyCount);
+        if (header.historyCount > 0) {
+            memcpy(history.data(), &buffer[historyOffset], header.historyCount * sizeof(uint32_t));
+        }
+        for (uint32_t word : history) {
+            Move move = Move::decode(word);
+            if (move.moveType > Move::ResetStockFromWaste || move.srcColumn >= 7 || move.destColumn >= 7) return false;
+        }
+
+        // The history must lead to the saved position: undo it on a scratch copy,
+        // then play it forward again by the rules and compare
+        game scratch(0);
+        scratch.setQuiet(true);
+        scratch.loadSnapshot(snap);
+        scratch.commandStack.assign(history.data(), (int)history.size());
+        for (size_t i = 0; i < history.size(); ++i) {
+            scratch.undoMove();
+            if (!scratch.fitsSnapshot()) return false;
+        }
+        GameSnapshot start;
+        scratch.saveSnapshot(start);
+        if (!isValidSnapshot(start)) return false;
+        for (uint32_t word : history) {
+            if (!scratch.applyMove(Move::decode(word))) return false;
+        }
+        GameSnapshot replayed;
+        scratch.saveSnapshot(replayed);
+        if (!sameSnapshot(replayed, snap)) return false;
+
+        loadSnapshot(snap);
+        memcpy(dealOrder, order, sizeof(dealOrder));
+        commandStack.assign(history.data(), (int)history.size());
+        return true;
+    }
+
+    // Copy a stack into an array, bottom card first
+    static void saveStack(const stack& pile, unsigned char* out) {
+        int n = pile.getsize();
+        for (Node* current = pile.getTopNode(); current != nullptr; current = current->next) {
+            out[--n] = encodeCard(current->val);
+        }
+    }
+
+    // Rebuild a stack from an array written by saveStack
+    static void loadStack(stack& pile, const unsigned char* cards, int count) {
+        pile.clear();
+        for (int n = 0; n < count; ++n) {
+            pile.pushNode(new Node(decodeCard(cards[n])));
+        }
+    }
+
     // Flips the next face-down card at the top of the specified tableau column, if it exists.
     void flipNextFaceDownCard(int column) {
         if (!tableau[column].isempty()) {
             Node* newTop = tableau[column].getNodeAt(tableau[column].getsize() - 1);  // Get the top card
             if (newTop != nullptr && !newTop->val.isFaceUp) {  // Check if it's face-down
                 newTop->val.isFaceUp = true;  // Flip the card face-up
-                cout << "The next card in tableau column " << column + 1 << " is now face-up." << endl;
+                msg() << "The next card in tableau column " << column + 1 << " is now face-up." << endl;
             }
         }
     }
 
-    void shuffleDeck(doublylinkedlist& deck) {
-        srand(unsigned(time(0)));  // Seed random number generation
+    void shuffleDeck(doublylinkedlist& deck, uint32_t seed) {
+        TRACE_SCOPE("game::shuffleDeck");
+        // Each game owns its generator so seeded deals are reproducible and
+        // games can be shuffled on several threads at once
+        mt19937 random(seed);
 
         int deckSize = deck.getSize();  // Get the size of the deck (52 cards)
         for (int i = 0; i < deckSize - 1; ++i) {
-            int j = i + rand() % (deckSize - i);  // Random remaining position
+            int j = i + random() % (deckSize - i);  // Random remaining position
             deck.swapNodes(i, j);  // Swap cards at positions i and j
         }
     }
 
     void dealCards(doublylinkedlist& deck) {
+        TRACE_SCOPE("game::dealCards");
         Node* current = deck.getHead();
+        int dealt = 0;
 
         // Deal cards to the tableau columns
         for (int i = 0; i < 7; ++i) {
             for (int j = 0; j <= i; ++j) {
                 if (current != nullptr) {
+                    dealOrder[dealt++] = encodeCard(current->val) & 0x3F;
                     current->val.isFaceUp = (j == i);
                     tableau[i].addNodeToEnd(new Node(current->val));
                     current = current->next;
@@ -466,6 +1211,7 @@ public:
 
         // Remaining cards go to the stockpile
         while (current != nullptr) {
+            dealOrder[dealt++] = encodeCard(current->val) & 0x3F;
             stockpile.pushNode(new Node(current->val));  // Add cards to stockpile
             current = current->next;
         }
@@ -473,9 +1219,15 @@ public:
 
     // Move a card(s) from one tableau column to another
     void moveCard(int srcColumn, int destColumn, int numOfCards) {
+        TRACE_SCOPE("game::moveCard");
         // Validate that the source and destination columns are within bounds
         if (srcColumn < 0 || srcColumn >= 7 || destColumn < 0 || destColumn >= 7) {
-            cout << "INVALID COLUMN INDICES." << endl;
+            msg() << "INVALID COLUMN INDICES." << endl;
+            return;
+        }
+
+        if (numOfCards < 1) {
+            msg() << "INVALID NUMBER OF CARDS." << endl;
             return;
         }
 
@@ -494,14 +1246,14 @@ public:
 
         // Check if the user is trying to move more cards than are face-up
         if (numOfCards > faceUpCount) {
-            cout << "ERROR: YOU ARE TRYING TO MOVE MORE CARDS THAN ARE FACE-UP. ONLY "
+            msg() << "ERROR: YOU ARE TRYING TO MOVE MORE CARDS THAN ARE FACE-UP. ONLY "
                 << faceUpCount << " FACE-UP CARDS AVAILABLE TO MOVE." << endl;
             return;
         }
 
         // Validate that the source column has enough cards
         if (tableau[srcColumn].getsize() < numOfCards) {
-            cout << "NOT ENOUGH CARDS IN THE SOURCE COLUMN." << endl;
+            msg() << "NOT ENOUGH CARDS IN THE SOURCE COLUMN." << endl;
             return;
         }
 
@@ -516,8 +1268,8 @@ public:
             Card nextCard = current->next->val;
 
             // Check if the cards are in descending order and alternating colors
-            if (!isonesmaller(nextCard, currentCard) || !isOppositeColor(nextCard.suit, currentCard.suit)) {
-                cout << "INVALID MOVE: CARDS MUST BE IN DESCENDING ORDER AND ALTERNATING COLORS." << endl;
+            if (!canStackOn(nextCard, currentCard)) {
+                msg() << "INVALID MOVE: CARDS MUST BE IN DESCENDING ORDER AND ALTERNATING COLORS." << endl;
                 return;
             }
 
@@ -529,15 +1281,15 @@ public:
             Card topDestCard = tableau[destColumn].getNodeAt(tableau[destColumn].getsize() - 1)->val;
 
             // Check that the first card being moved is one rank smaller and of the opposite color
-            if (!isonesmaller(firstCardToMove, topDestCard) || !isOppositeColor(firstCardToMove.suit, topDestCard.suit)) {
-                cout << "INVALID MOVE: THE FIRST CARD MUST BE ONE RANK LOWER THAN THE DESTINATION CARD AND OF THE OPPOSITE COLOR." << endl;
+            if (!canStackOn(firstCardToMove, topDestCard)) {
+                msg() << "INVALID MOVE: THE FIRST CARD MUST BE ONE RANK LOWER THAN THE DESTINATION CARD AND OF THE OPPOSITE COLOR." << endl;
                 return;
             }
         }
         else {
             // If the destination column is empty, only allow moving a King
             if (!canMoveToEmptyTableau(firstCardToMove)) {
-                cout << "INVALID MOVE: ONLY A KING CAN BE PLACED IN AN EMPTY COLUMN." << endl;
+                msg() << "INVALID MOVE: ONLY A KING CAN BE PLACED IN AN EMPTY COLUMN." << endl;
                 return;
             }
         }
@@ -564,11 +1316,12 @@ public:
 
         commandStack.pushMove(move);
 
-        cout << "MOVE SUCCESSFUL!" << endl;
+        msg() << "MOVE SUCCESSFUL!" << endl;
     }
 
     // Puts cards from wastepile to stockpile when stockpile gets empty
     void resetStockpileFromWastepile() {
+        TRACE_SCOPE("game::resetStockpileFromWastepile");
         stack tempStack;
 
         // Reverse the order by pushing wastepile cards into a temporary stack
@@ -581,11 +1334,12 @@ public:
             stockpile.pushNode(tempStack.popNode());
         }
 
-        cout << "WASTEPILE HAS BEEN RESET INTO THE STOCKPILE." << endl;
+        msg() << "WASTEPILE HAS BEEN RESET INTO THE STOCKPILE." << endl;
     }
 
     // Draw a card from stockpile
     void drawCardFromStockpile() {
+        TRACE_SCOPE("game::drawCardFromStockpile");
         if (stockpile.isempty()) {
             // Reset the stockpile from the wastepile
             resetStockpileFromWastepile();
@@ -611,9 +1365,15 @@ public:
 
     // Move a card from waste to tableau
     void moveFromWasteToTableau(int destColumn) {
+        TRACE_SCOPE("game::moveFromWasteToTableau");
+        if (destColumn < 0 || destColumn >= 7) {
+            msg() << "INVALID TABLEAU COLUMN INDEX." << endl;
+            return;
+        }
+
         // Check if wastepile is empty
         if (wastepile.isempty()) {
-            cout << "WASTEPILE IS EMPTY" << endl;
+            msg() << "WASTEPILE IS EMPTY" << endl;
             return;
         }
 
@@ -625,7 +1385,7 @@ public:
         if (tableau[destColumn].isempty()) {
             if (canMoveToEmptyTableau(cardNode->val)) {
                 tableau[destColumn].addNodeToEnd(cardNode);
-                cout << "KING MOVED TO EMPTY TABLEAU COLUMN." << endl;
+                msg() << "KING MOVED TO EMPTY TABLEAU COLUMN." << endl;
                 Move move;
                 move.moveType = Move::MoveWasteToTableau;
                 move.destColumn = destColumn;
@@ -635,7 +1395,7 @@ public:
             }
             else {
                 // Invalid move, push the card back to the wastepile
-                cout << "INVALID MOVE: ONLY A KING CAN BE PLACED IN AN EMPTY TABLEAU COLUMN." << endl;
+                msg() << "INVALID MOVE: ONLY A KING CAN BE PLACED IN AN EMPTY TABLEAU COLUMN." << endl;
                 wastepile.pushNode(cardNode);
             }
             return;
@@ -645,9 +1405,9 @@ public:
         Card lastTableauCard = tableau[destColumn].getNodeAt(tableau[destColumn].getsize() - 1)->val;
 
         // Check if the card from waste can be moved based on rank and color rules
-        if (isOppositeColor(cardNode->val.suit, lastTableauCard.suit) && isonesmaller(cardNode->val, lastTableauCard)) {
+        if (canStackOn(cardNode->val, lastTableauCard)) {
             tableau[destColumn].addNodeToEnd(cardNode);  // Move the Node directly to the tableau
-            cout << "CARD SUCCESSFULLY MOVED TO TABLEAU." << endl;
+            msg() << "CARD SUCCESSFULLY MOVED TO TABLEAU." << endl;
             Move move;
             move.moveType = Move::MoveWasteToTableau;
             move.destColumn = destColumn;
@@ -657,22 +1417,23 @@ public:
         }
         else {
             // Invalid move, push the card back to the wastepile
-            cout << "INVALID MOVE: CARD MUST BE OF A DIFFERENT COLOR AND ONE RANK LOWER." << endl;
+            msg() << "INVALID MOVE: CARD MUST BE OF A DIFFERENT COLOR AND ONE RANK LOWER." << endl;
             wastepile.pushNode(cardNode);
         }
     }
 
     // Move a card from waste to foundation
     void moveFromWasteToFoundation(int f) {
+        TRACE_SCOPE("game::moveFromWasteToFoundation");
         // Checks if wastepile is empty
         if (wastepile.isempty()) {
-            cout << "WASTEPILE IS EMPTY" << endl;
+            msg() << "WASTEPILE IS EMPTY" << endl;
             return;
         }
 
         // Checks if the entered foundation number is within range
         if (f < 0 || f > 3) {
-            cout << "INVALID FOUNDATION COLUMN. PLEASE USE COLUMNS 0 TO 3." << endl;
+            msg() << "INVALID FOUNDATION COLUMN. PLEASE USE COLUMNS 0 TO 3." << endl;
             return;
         }
 
@@ -682,26 +1443,26 @@ public:
         bool moveSuccessful = false;
 
         if (foundation[f].isempty()) {
-            if (cardNode->val.rank == 1) {
+            if (canStartFoundation(cardNode->val)) {
                 foundation[f].pushNode(cardNode);
-                cout << "CARD MOVED TO EMPTY FOUNDATION PILE." << endl;
+                msg() << "CARD MOVED TO EMPTY FOUNDATION PILE." << endl;
                 moveSuccessful = true;
             }
             else {
-                cout << "ONLY AN ACE CAN BE PLACED IN AN EMPTY FOUNDATION PILE." << endl;
+                msg() << "ONLY AN ACE CAN BE PLACED IN AN EMPTY FOUNDATION PILE." << endl;
                 wastepile.pushNode(cardNode);
             }
         }
         else {
             Card topFoundationCard = foundation[f].topItem();
 
-            if (cardNode->val.suit == topFoundationCard.suit && cardNode->val.rank == topFoundationCard.rank + 1) {
+            if (canGoOnFoundation(cardNode->val, topFoundationCard)) {
                 foundation[f].pushNode(cardNode);
-                cout << "CARD SUCCESSFULLY MOVED TO FOUNDATION." << endl;
+                msg() << "CARD SUCCESSFULLY MOVED TO FOUNDATION." << endl;
                 moveSuccessful = true;
             }
             else {
-                cout << "INVALID MOVE: CARD MUST BE OF THE SAME SUIT AND ONE RANK HIGHER." << endl;
+                msg() << "INVALID MOVE: CARD MUST BE OF THE SAME SUIT AND ONE RANK HIGHER." << endl;
                 wastepile.pushNode(cardNode);
             }
         }
@@ -719,15 +1480,16 @@ public:
 
     // Move a card from tableau to foundation
     void moveFromTableauToFoundation(int srcColumn, int foundationIndex) {
+        TRACE_SCOPE("game::moveFromTableauToFoundation");
         // Checks if the entered source column is within range and also checks if the entered foundation index is within range
         if (srcColumn < 0 || srcColumn >= 7 || foundationIndex < 0 || foundationIndex >= 4) {
-            cout << "INVALID COLUMN OR FOUNDATION INDEX." << endl;
+            msg() << "INVALID COLUMN OR FOUNDATION INDEX." << endl;
             return;
         }
 
         // Checks if the tableau is empty
         if (tableau[srcColumn].isempty()) {
-            cout << "NO CARDS IN THE TABLEAU COLUMN." << endl;
+            msg() << "NO CARDS IN THE TABLEAU COLUMN." << endl;
             return;
         }
 
@@ -737,26 +1499,26 @@ public:
         bool moveSuccessful = false;
 
         if (foundation[foundationIndex].isempty()) {
-            if (cardNode->val.rank == 1) {
+            if (canStartFoundation(cardNode->val)) {
                 foundation[foundationIndex].pushNode(cardNode);  // Move the Node directly to foundation
                 moveSuccessful = true;
-                cout << "CARD MOVED TO FOUNDATION." << endl;
+                msg() << "CARD MOVED TO FOUNDATION." << endl;
             }
             else {
-                cout << "ONLY AN ACE CAN BE PLACED IN AN EMPTY FOUNDATION." << endl;
+                msg() << "ONLY AN ACE CAN BE PLACED IN AN EMPTY FOUNDATION." << endl;
                 tableau[srcColumn].addNodeToEnd(cardNode);  // Put the Node back if invalid move
             }
         }
         else {
             Card topFoundationCard = foundation[foundationIndex].topItem();
 
-            if (cardNode->val.suit == topFoundationCard.suit && cardNode->val.rank == topFoundationCard.rank + 1) {
+            if (canGoOnFoundation(cardNode->val, topFoundationCard)) {
                 foundation[foundationIndex].pushNode(cardNode);  // Move the Node to foundation
                 moveSuccessful = true;
-                cout << "CARD MOVED TO FOUNDATION." << endl;
+                msg() << "CARD MOVED TO FOUNDATION." << endl;
             }
             else {
-                cout << "INVALID MOVE: CARD MUST BE OF THE SAME SUIT AND ONE RANK HIGHER." << endl;
+                msg() << "INVALID MOVE: CARD MUST BE OF THE SAME SUIT AND ONE RANK HIGHER." << endl;
                 tableau[srcColumn].addNodeToEnd(cardNode);  // Put the Node back if the move is invalid
             }
         }
@@ -785,42 +1547,44 @@ public:
 
     // Move a card from foundation to tableau
     void moveFromFoundationToTableau(int foundationIndex, int destColumn) {
+        TRACE_SCOPE("game::moveFromFoundationToTableau");
         if (foundationIndex < 0 || foundationIndex >= 4 || destColumn < 0 || destColumn >= 7) {
-            cout << "INVALID FOUNDATION OR TABLEAU COLUMN INDEX." << endl;
+            msg() << "INVALID FOUNDATION OR TABLEAU COLUMN INDEX." << endl;
             return;
         }
 
         if (foundation[foundationIndex].isempty()) {
-            cout << "NO CARDS IN THE FOUNDATION PILE." << endl;
+            msg() << "NO CARDS IN THE FOUNDATION PILE." << endl;
             return;
         }
 
         // Pop the Node from foundation
         Node* cardNode = foundation[foundationIndex].popNode();
+        cardNode->val.isFaceUp = true;  // waste cards reach the foundation without being turned up
 
         bool moveSuccessful = false;
 
         if (tableau[destColumn].isempty()) {
-            if (cardNode->val.rank == 13) {  // Only a King can be placed in an empty tableau column
+            if (canMoveToEmptyTableau(cardNode->val)) {
                 tableau[destColumn].addNodeToEnd(cardNode);
                 moveSuccessful = true;
-                cout << "CARD MOVED FROM FOUNDATION TO TABLEAU." << endl;
+                msg() << "CARD MOVED FROM FOUNDATION TO TABLEAU." << endl;
             }
             else {
-                cout << "ONLY A KING CAN BE PLACED IN AN EMPTY TABLEAU COLUMN." << endl;
+                msg() << "ONLY A KING CAN BE PLACED IN AN EMPTY TABLEAU COLUMN." << endl;
                 foundation[foundationIndex].pushNode(cardNode);  // Put it back if invalid move
             }
         }
         else {
             Card topTableauCard = tableau[destColumn].getNodeAt(tableau[destColumn].getsize() - 1)->val;
 
-            if (isonesmaller(cardNode->val, topTableauCard) && isOppositeColor(cardNode->val.suit, topTableauCard.suit)) {
+            if (canStackOn(cardNode->val, topTableauCard)) {
                 tableau[destColumn].addNodeToEnd(cardNode);  // Move the Node to tableau
                 moveSuccessful = true;
-                cout << "CARD MOVED FROM FOUNDATION TO TABLEAU." << endl;
+                msg() << "CARD MOVED FROM FOUNDATION TO TABLEAU." << endl;
             }
             else {
-                cout << "INVALID MOVE: CARD MUST BE ONE RANK LOWER AND OF OPPOSITE COLOR." << endl;
+                msg() << "INVALID MOVE: CARD MUST BE ONE RANK LOWER AND OF OPPOSITE COLOR." << endl;
                 foundation[foundationIndex].pushNode(cardNode);  // Put the Node back if the move is invalid
             }
         }
@@ -839,8 +1603,9 @@ public:
 
     // Undo the previous move
     void undoMove() {
+        TRACE_SCOPE("game::undoMove");
         if (commandStack.isempty()) {
-            cout << "NO MOVES TO UNDO." << endl;
+            msg() << "NO MOVES TO UNDO." << endl;
             return;
         }
         Move move = commandStack.popMove();
@@ -855,7 +1620,7 @@ public:
             }
             // Move cards back from destColumn to srcColumn
             tableau[move.destColumn].movecard(tableau[move.srcColumn], move.numOfCards);
-            cout << "UNDO SUCCESSFUL: MOVED CARDS BACK FROM COLUMN " << move.destColumn + 1
+            msg() << "UNDO SUCCESSFUL: MOVED CARDS BACK FROM COLUMN " << move.destColumn + 1
                 << " TO COLUMN " << move.srcColumn + 1 << "." << endl;
             break;
         }
@@ -865,10 +1630,10 @@ public:
             if (!wastepile.isempty()) {
                 Node* cardNode = wastepile.popNode();
                 stockpile.pushNode(cardNode);
-                cout << "UNDO SUCCESSFUL: MOVED CARD BACK FROM WASTEPILE TO STOCKPILE." << endl;
+                msg() << "UNDO SUCCESSFUL: MOVED CARD BACK FROM WASTEPILE TO STOCKPILE." << endl;
             }
             else {
-                cout << "ERROR: WASTEPILE IS EMPTY DURING UNDO." << endl;
+                msg() << "ERROR: WASTEPILE IS EMPTY DURING UNDO." << endl;
             }
             break;
         }
@@ -878,10 +1643,10 @@ public:
             if (!tableau[move.destColumn].isempty()) {
                 Node* cardNode = tableau[move.destColumn].removeLastNode();
                 wastepile.pushNode(cardNode);
-                cout << "UNDO SUCCESSFUL: MOVED CARD BACK FROM TABLEAU TO WASTEPILE." << endl;
+                msg() << "UNDO SUCCESSFUL: MOVED CARD BACK FROM TABLEAU TO WASTEPILE." << endl;
             }
             else {
-                cout << "ERROR: TABLEAU COLUMN IS EMPTY DURING UNDO." << endl;
+                msg() << "ERROR: TABLEAU COLUMN IS EMPTY DURING UNDO." << endl;
             }
             break;
         }
@@ -899,11 +1664,11 @@ public:
                 Node* cardNode = foundation[move.foundationIndex].popNode();
                 tableau[move.srcColumn].addNodeToEnd(cardNode);
 
-                cout << "UNDO SUCCESSFUL: MOVED CARD BACK FROM FOUNDATION TO TABLEAU COLUMN "
+                msg() << "UNDO SUCCESSFUL: MOVED CARD BACK FROM FOUNDATION TO TABLEAU COLUMN "
                     << move.srcColumn + 1 << "." << endl;
             }
             else {
-                cout << "ERROR: FOUNDATION PILE IS EMPTY DURING UNDO." << endl;
+                msg() << "ERROR: FOUNDATION PILE IS EMPTY DURING UNDO." << endl;
             }
             break;
         }
@@ -913,10 +1678,10 @@ public:
             if (!foundation[move.foundationIndex].isempty()) {
                 Node* cardNode = foundation[move.foundationIndex].popNode();
                 wastepile.pushNode(cardNode);
-                cout << "UNDO SUCCESSFUL: MOVED CARD BACK FROM FOUNDATION TO WASTEPILE." << endl;
+                msg() << "UNDO SUCCESSFUL: MOVED CARD BACK FROM FOUNDATION TO WASTEPILE." << endl;
             }
             else {
-                cout << "ERROR: FOUNDATION PILE IS EMPTY DURING UNDO." << endl;
+                msg() << "ERROR: FOUNDATION PILE IS EMPTY DURING UNDO." << endl;
             }
             break;
         }
@@ -926,11 +1691,11 @@ public:
             if (!tableau[move.destColumn].isempty()) {
                 Node* cardNode = tableau[move.destColumn].removeLastNode();
                 foundation[move.foundationIndex].pushNode(cardNode);
-                cout << "UNDO SUCCESSFUL: MOVED CARD BACK FROM TABLEAU TO FOUNDATION PILE "
+                msg() << "UNDO SUCCESSFUL: MOVED CARD BACK FROM TABLEAU TO FOUNDATION PILE "
                     << move.foundationIndex + 1 << "." << endl;
             }
             else {
-                cout << "ERROR: TABLEAU COLUMN IS EMPTY DURING UNDO." << endl;
+                msg() << "ERROR: TABLEAU COLUMN IS EMPTY DURING UNDO." << endl;
             }
             break;
         }
@@ -949,29 +1714,440 @@ public:
                 wastepile.pushNode(tempStack.popNode());
             }
 
-            cout << "UNDO SUCCESSFUL: RESET STOCKPILE BACK TO WASTEPILE." << endl;
+            msg() << "UNDO SUCCESSFUL: RESET STOCKPILE BACK TO WASTEPILE." << endl;
             break;
         }
 
         default:
-            cout << "UNDO NOT IMPLEMENTED FOR THIS MOVE TYPE." << endl;
+            msg() << "UNDO NOT IMPLEMENTED FOR THIS MOVE TYPE." << endl;
             break;
         }
     }
 
-    // Check if the game is won
-    bool checkIfGameWon() {
-        for (int i = 0; i < 4; ++i) {
-            if (foundation[i].isempty() || foundation[i].topItem().rank != 13) {
-                return false;
+    // Rank of the highest card of the given suit on the foundations, 0 if none
+    int foundationRankForSuit(char suit) const {
+        for (int f = 0; f < 4; ++f) {
+            if (!foundation[f].isempty() && foundation[f].topItem().suit == suit) {
+                return foundation[f].topItem().rank;
             }
         }
-        return true;
+        return 0;
     }
 
-    // Check if no more moves are possible
-    bool checkIfNoMoreMoves() {
-        // Check if there are valid moves between tableau columns
+    // Foundation pile the card can legally go to, or -1 if none
+    int foundationFor(const Card& card) const {
+        for (int f = 0; f < 4; ++f) {
+            if (foundation[f].isempty()) {
+                if (canStartFoundation(card)) return f;
+            }
+            else {
+                Card topFoundationCard = foundation[f].topItem();
+                if (canGoOnFoundation(card, topFoundationCard)) return f;
+            }
+        }
+        return -1;
+    }
+
+    // Dominance rule: moving this card to a foundation can never hurt because no
+    // card that might still need to be placed on it in the tableau is left out
+    bool isSafeToFoundation(const Card& card) const {
+        if (card.rank <= 2) return true;
+
+        int minOpposite = 13;
+        int otherSameColor = 13;
+        for (char suit : SUITS) {
+            if (suit == card.suit) continue;
+            int rank = foundationRankForSuit(suit);
+            if (isOppositeColor(suit, card.suit)) {
+                if (rank < minOpposite) minOpposite = rank;
+            }
+            else {
+                otherSameColor = rank;
+            }
+        }
+
+        // Both opposite-color cards one rank lower are already home
+        if (card.rank <= minOpposite + 1) return true;
+        // The opposite-color cards one rank lower could only still be needed
+        // to hold same-color cards two ranks lower, and those are home too
+        return card.rank <= minOpposite + 2 && otherSameColor >= card.rank - 3;
+    }
+
+    // Find a forced move: a waste or tableau top card that can go to a foundation
+    // and passes isSafeToFoundation. Search engines can play it without branching.
+    bool findSafeFoundationMove(Move& move) const {
+        if (!wastepile.isempty()) {
+            Card wasteTopCard = wastepile.topItem();
+            int f = foundationFor(wasteTopCard);
+            if (f >= 0 && isSafeToFoundation(wasteTopCard)) {
+                move.moveType = Move::MoveWasteToFoundation;
+                move.foundationIndex = f;
+                move.movedCard = wasteTopCard;
+                return true;
+            }
+        }
+
+        for (int col = 0; col < 7; ++col) {
+            Node* top = tableau[col].getTail();
+            if (top == nullptr) continue;
+            int f = foundationFor(top->val);
+            if (f >= 0 && isSafeToFoundation(top->val)) {
+                move.moveType = Move::MoveTableauToFoundation;
+                move.srcColumn = col;
+                move.foundationIndex = f;
+                move.movedCard = top->val;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Repeatedly play forced foundation moves; returns how many cards were moved
+    int autoPlayToFoundations() {
+        int moved = 0;
+        Move move;
+        while (findSafeFoundationMove(move)) {
+            if (move.moveType == Move::MoveWasteToFoundation) {
+                moveFromWasteToFoundation(move.foundationIndex);
+            }
+            else {
+                moveFromTableauToFoundation(move.srcColumn, move.foundationIndex);
+            }
+            moved++;
+        }
+        return moved;
+    }
+
+    // True once the stock and waste are empty and every tableau card is face up.
+    // Each column is then a single descending alternating run, so the lowest card
+    // left is always on top of a column and can go home: the game is won, and
+    // search can stop here and call finishGame.
+    bool isEndgameDecided() const {
+        return stockpile.isempty() && wastepile.isempty() && faceDownCount() == 0;
+    }
+
+    // Play out a decided endgame: move column tops to the foundations until every
+    // card is home. Moves are recorded for undo but not announced one by one.
+    // Returns the number of cards moved.
+    int finishGame() {
+        if (!isEndgameDecided()) return 0;
+
+        bool wasQuiet = quiet;
+        quiet = true;
+        int moved = 0;
+        bool progress = true;
+        while (progress) {
+            progress = false;
+            for (int col = 0; col < 7; ++col) {
+                Node* top = tableau[col].getTail();
+                if (top == nullptr) continue;
+                int f = foundationFor(top->val);
+                if (f >= 0) {
+                    moveFromTableauToFoundation(col, f);
+                    moved++;
+                    progress = true;
+                }
+            }
+        }
+        quiet = wasQuiet;
+        return moved;
+    }
+
+    // Static deadlock check, no search. Looks for a set of tableau cards none of which
+    // can ever leave its column. A card X in the set could only leave by going to a
+    // foundation, which needs every lower card of its suit home first, or onto one of
+    // its two parents (opposite color, one rank higher). If a lower same-suit card and
+    // both parents all sit underneath X or underneath another card of the set, then no
+    // card of the set can be the first to leave, and the game can never be won.
+    // Kings are left out because they can always escape to an empty column, and so is
+    // a card resting face up on its own parent, since the two may move as one run.
+    // Returns true if the position is provably unwinnable; stuckCard is one such card.
+    bool findDeadlock(Card& stuckCard) const {
+        int column[52], row[52];
+        bool inSet[52] = {};
+        for (int id = 0; id < 52; ++id) column[id] = -1;
+
+        for (int col = 0; col < 7; ++col) {
+            int r = 0;
+            Node* below = nullptr;
+            for (Node* current = tableau[col].getHead(); current != nullptr; current = current->next, ++r) {
+                int id = encodeCard(current->val) & 0x3F;
+                column[id] = col;
+                row[id] = r;
+                bool restsOnParent = below != nullptr && below->val.isFaceUp
+                    && canStackOn(current->val, below->val);
+                inSet[id] = !canMoveToEmptyTableau(current->val) && !restsOnParent;
+                below = current;
+            }
+        }
+
+        // Shrink the set until every member is blocked by the others
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            int topOfSet[7];
+            for (int col = 0; col < 7; ++col) topOfSet[col] = -1;
+            for (int id = 0; id < 52; ++id) {
+                if (inSet[id] && row[id] > topOfSet[column[id]]) topOfSet[column[id]] = row[id];
+            }
+            auto blocked = [&](int id) {
+                return column[id] >= 0 && row[id] < topOfSet[column[id]];
+            };
+
+            for (int id = 0; id < 52; ++id) {
+                if (!inSet[id]) continue;
+                int suit = id / 13;
+                int rank = id % 13 + 1;
+
+                bool foundationBlocked = false;
+                int home = foundationRankForSuit(SUITS[suit]);
+                for (int lower = home + 1; lower < rank && !foundationBlocked; ++lower) {
+                    foundationBlocked = blocked(suit * 13 + lower - 1);
+                }
+
+                bool parentsBlocked = true;
+                for (int parentSuit = 0; parentSuit < 4 && parentsBlocked; ++parentSuit) {
+                    if (!isOppositeColor(SUITS[parentSuit], SUITS[suit])) continue;
+                    parentsBlocked = blocked(parentSuit * 13 + rank);
+                }
+
+                if (!foundationBlocked || !parentsBlocked) {
+                    inSet[id] = false;
+                    changed = true;
+                }
+            }
+        }
+
+        for (int id = 0; id < 52; ++id) {
+            if (inSet[id]) {
+                stuckCard = decodeCard((unsigned char)id);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // 64-bit FNV-1a hash of the position (piles and tableau face-up flags, not the
+    // history), used to key visited sets and result caches
+    uint64_t positionHash() const {
+        uint64_t hash = 1469598103934665603ULL;
+        auto mix = [&hash](unsigned char byte) {
+            hash ^= byte;
+            hash *= 1099511628211ULL;
+        };
+        for (int col = 0; col < 7; ++col) {
+            for (Node* current = tableau[col].getHead(); current != nullptr; current = current->next) {
+                mix(encodeCard(current->val));
+            }
+            mix(0xFF);
+        }
+        // Outside the tableau the face-up flag carries no meaning, so it is masked off
+        const stack* piles[6] = { &foundation[0], &foundation[1], &foundation[2], &foundation[3], &stockpile, &wastepile };
+        for (const stack* pile : piles) {
+            for (Node* current = pile->getTopNode(); current != nullptr; current = current->next) {
+                mix(encodeCard(current->val) & 0x3F);
+            }
+            mix(0xFF);
+        }
+        return hash;
+    }
+
+    // Undo history, oldest move first
+    const MoveStack& getHistory() const {
+        return commandStack;
+    }
+
+    // Read-only access to the piles for agents and analysis code
+    const doublylinkedlist& getTableau(int column) const {
+        return tableau[column];
+    }
+
+    const stack& getFoundation(int index) const {
+        return foundation[index];
+    }
+
+    const stack& getStockpile() const {
+        return stockpile;
+    }
+
+    const stack& getWastepile() const {
+        return wastepile;
+    }
+
+    // Number of face-down cards left in the tableau
+    int faceDownCount() const {
+        int count = 0;
+        for (int col = 0; col < 7; ++col) {
+            for (Node* current = tableau[col].getHead(); current != nullptr && !current->val.isFaceUp; current = current->next) {
+                count++;
+            }
+        }
+        return count;
+    }
+
+    // Fill moves with every legal move in this position and return how many there are.
+    // Moving a King that already sits at the bottom of a column to another empty
+    // column changes nothing and is left out. moves must hold MAX_MOVES entries.
+    int generateMoves(Move* moves) const {
+        int count = 0;
+
+        // Tableau to tableau: every valid face-up run ending at the top card
+        for (int src = 0; src < 7; ++src) {
+            Node* first = tableau[src].getTail();
+            int runLength = 0;
+            while (first != nullptr && first->val.isFaceUp) {
+                runLength++;
+                Node* below = first->prev;
+                for (int dest = 0; dest < 7; ++dest) {
+                    if (dest == src) continue;
+                    Node* destTop = tableau[dest].getTail();
+                    bool fits = destTop == nullptr
+                        ? canMoveToEmptyTableau(first->val) && below != nullptr
+                        : canStackOn(first->val, destTop->val);
+                    if (fits) {
+                        Move& move = moves[count++];
+                        move = Move();
+                        move.moveType = Move::MoveTableauToTableau;
+                        move.srcColumn = src;
+                        move.destColumn = dest;
+                        move.numOfCards = runLength;
+                        move.flippedColumn = src;
+                    }
+                }
+                if (below == nullptr || !below->val.isFaceUp
+                    || !canStackOn(first->val, below->val)) {
+                    break;
+                }
+                first = below;
+            }
+        }
+
+        // Waste to tableau and foundation
+        if (!wastepile.isempty()) {
+            Card wasteTopCard = wastepile.topItem();
+            for (int dest = 0; dest < 7; ++dest) {
+                Node* destTop = tableau[dest].getTail();
+                bool fits = destTop == nullptr
+                    ? canMoveToEmptyTableau(wasteTopCard)
+                    : canStackOn(wasteTopCard, destTop->val);
+                if (fits) {
+                    Move& move = moves[count++];
+                    move = Move();
+                    move.moveType = Move::MoveWasteToTableau;
+                    move.destColumn = dest;
+                    move.movedCard = wasteTopCard;
+                }
+            }
+            int f = foundationFor(wasteTopCard);
+            if (f >= 0) {
+                Move& move = moves[count++];
+                move = Move();
+                move.moveType = Move::MoveWasteToFoundation;
+                move.foundationIndex = f;
+                move.movedCard = wasteTopCard;
+            }
+        }
+
+        // Tableau to foundation
+        for (int src = 0; src < 7; ++src) {
+            Node* top = tableau[src].getTail();
+            if (top == nullptr) continue;
+            int f = foundationFor(top->val);
+            if (f >= 0) {
+                Move& move = moves[count++];
+                move = Move();
+                move.moveType = Move::MoveTableauToFoundation;
+                move.srcColumn = src;
+                move.foundationIndex = f;
+                move.movedCard = top->val;
+                move.flippedColumn = src;
+            }
+        }
+
+        // Foundation back to tableau
+        for (int f = 0; f < 4; ++f) {
+            if (foundation[f].isempty()) continue;
+            Card foundationTopCard = foundation[f].topItem();
+            for (int dest = 0; dest < 7; ++dest) {
+                Node* destTop = tableau[dest].getTail();
+                bool fits = destTop == nullptr
+                    ? canMoveToEmptyTableau(foundationTopCard)
+                    : canStackOn(foundationTopCard, destTop->val);
+                if (fits) {
+                    Move& move = moves[count++];
+                    move = Move();
+                    move.moveType = Move::MoveFoundationToTableau;
+                    move.foundationIndex = f;
+                    move.destColumn = dest;
+                    move.movedCard = foundationTopCard;
+                }
+            }
+        }
+
+        // Draw from the stock, or turn the waste over when the stock is empty
+        if (!stockpile.isempty() || !wastepile.isempty()) {
+            Move& move = moves[count++];
+            move = Move();
+            move.moveType = stockpile.isempty() ? Move::ResetStockFromWaste : Move::DrawStockToWaste;
+        }
+
+        return count;
+    }
+
+    // Apply a move through the normal movers; returns false if it was illegal
+    bool applyMove(const Move& move) {
+        int before = commandStack.getsize();
+        switch (move.moveType) {
+        case Move::DrawStockToWaste:
+        case Move::ResetStockFromWaste:
+            drawCardFromStockpile();
+            break;
+        case Move::MoveTableauToTableau:
+            moveCard(move.srcColumn, move.destColumn, move.numOfCards);
+            break;
+        case Move::MoveWasteToTableau:
+            moveFromWasteToTableau(move.destColumn);
+            break;
+        case Move::MoveWasteToFoundation:
+            moveFromWasteToFoundation(move.foundationIndex);
+            break;
+        case Move::MoveTableauToFoundation:
+            moveFromTableauToFoundation(move.srcColumn, move.foundationIndex);
+            break;
+        case Move::MoveFoundationToTableau:
+            moveFromFoundationToTableau(move.foundationIndex, move.destColumn);
+            break;
+        }
+        return commandStack.getsize() > before;
+    }
+
+    // Apply a move from a game log as strictly as a cheat check needs: a draw needs
+    // a card in the stock, a reset an empty stock and a non-empty waste, and the record
+    // the movers write (moved card and flip included) must equal the logged one
+    bool applyRecordedMove(uint32_t packed) {
+        uint32_t card = (packed >> 17) & 0x7F;
+        if (card != 0x7F && (card & 0x3F) >= 52) return false;
+        Move move = Move::decode(packed);
+        if (move.moveType == Move::DrawStockToWaste && stockpile.isempty()) return false;
+        if (move.moveType == Move::ResetStockFromWaste && (!stockpile.isempty() || wastepile.isempty())) return false;
+        if (!applyMove(move)) return false;
+        return commandStack.rawData()[commandStack.getsize() - 1] == packed;
+    }
+
+    // Check if the game is won
+    bool checkIfGameWon() {
+        for (int i = 0; i < 4; ++i) {
+            if (foundation[i].isempty() || foundation[i].topItem().rank != 13) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Check if no more moves are possible
+    bool checkIfNoMoreMoves() {
+        TRACE_SCOPE("game::checkIfNoMoreMoves");
+        // Check if there are valid moves between tableau columns
         for (int src = 0; src < 7; ++src) {
             if (tableau[src].isempty()) continue;
 
@@ -991,7 +2167,7 @@ public:
                     Card destTopCard = tableau[dest].getNodeAt(tableau[dest].getsize() - 1)->val;
 
                     // Check if the move is valid based on rank and color
-                    if (isonesmaller(srcTopCard, destTopCard) && isOppositeColor(srcTopCard.suit, destTopCard.suit)) {
+                    if (canStackOn(srcTopCard, destTopCard)) {
                         return false;
                     }
                 }
@@ -1011,7 +2187,7 @@ public:
                 else {
                     Card destTopCard = tableau[dest].getNodeAt(tableau[dest].getsize() - 1)->val;
 
-                    if (isonesmaller(wasteTopCard, destTopCard) && isOppositeColor(wasteTopCard.suit, destTopCard.suit)) {
+                    if (canStackOn(wasteTopCard, destTopCard)) {
                         return false;
                     }
                 }
@@ -1025,11 +2201,11 @@ public:
 
                 for (int f = 0; f < 4; ++f) {
                     if (foundation[f].isempty()) {
-                        if (tableauTopCard.rank == 1) return false;
+                        if (canStartFoundation(tableauTopCard)) return false;
                     }
                     else {
                         Card foundationTopCard = foundation[f].topItem();
-                        if (tableauTopCard.suit == foundationTopCard.suit && tableauTopCard.rank == foundationTopCard.rank + 1) {
+                        if (canGoOnFoundation(tableauTopCard, foundationTopCard)) {
                             return false;
                         }
                     }
@@ -1043,11 +2219,11 @@ public:
 
             for (int f = 0; f < 4; ++f) {
                 if (foundation[f].isempty()) {
-                    if (wasteTopCard.rank == 1) return false;
+                    if (canStartFoundation(wasteTopCard)) return false;
                 }
                 else {
                     Card foundationTopCard = foundation[f].topItem();
-                    if (wasteTopCard.suit == foundationTopCard.suit && wasteTopCard.rank == foundationTopCard.rank + 1) {
+                    if (canGoOnFoundation(wasteTopCard, foundationTopCard)) {
                         return false;
                     }
                 }
@@ -1064,6 +2240,7 @@ public:
 
     // Print the current game state
     void printGameState() const {
+        TRACE_SCOPE("game::printGameState");
         // Display the top of the game board: Stockpile, Wastepile, Foundations
         cout << left;
         cout << setw(10) << "Stock" << setw(10) << "Waste"
@@ -1157,169 +2334,3687 @@ public:
 
 };
 
-//ascii art
-void displayMainScreen() {
- 
-    cout << R"(
-
-
-                                                                                                                                                                              
-                                                                                                                                                                              
-   SSSSSSSSSSSSSSS      OOOOOOOOO     LLLLLLLLLLL             IIIIIIIIIITTTTTTTTTTTTTTTTTTTTTTT         AAA               IIIIIIIIIIRRRRRRRRRRRRRRRRR   EEEEEEEEEEEEEEEEEEEEEE
- SS:::::::::::::::S   OO:::::::::OO   L:::::::::L             I::::::::IT:::::::::::::::::::::T        A:::A              I::::::::IR::::::::::::::::R  E::::::::::::::::::::E
-S:::::SSSSSS::::::S OO:::::::::::::OO L:::::::::L             I::::::::IT:::::::::::::::::::::T       A:::::A             I::::::::IR::::::RRRRRR:::::R E::::::::::::::::::::E
-S:::::S     SSSSSSSO:::::::OOO:::::::OLL:::::::LL             II::::::IIT:::::TT:::::::TT:::::T      A:::::::A            II::::::IIRR:::::R     R:::::REE::::::EEEEEEEEE::::E
-S:::::S            O::::::O   O::::::O  L:::::L                 I::::I  TTTTTT  T:::::T  TTTTTT     A:::::::::A             I::::I    R::::R     R:::::R  E:::::E       EEEEEE
-S:::::S            O:::::O     O:::::O  L:::::L                 I::::I          T:::::T            A:::::A:::::A            I::::I    R::::R     R:::::R  E:::::E             
- S::::SSSS         O:::::O     O:::::O  L:::::L                 I::::I          T:::::T           A:::::A A:::::A           I::::I    R::::RRRRRR:::::R   E::::::EEEEEEEEEE   
-  SS::::::SSSSS    O:::::O     O:::::O  L:::::L                 I::::I          T:::::T          A:::::A   A:::::A          I::::I    R:::::::::::::RR    E:::::::::::::::E   
-    SSS::::::::SS  O:::::O     O:::::O  L:::::L                 I::::I          T:::::T         A:::::A     A:::::A         I::::I    R::::RRRRRR:::::R   E:::::::::::::::E   
-       SSSSSS::::S O:::::O     O:::::O  L:::::L                 I::::I          T:::::T        A:::::AAAAAAAAA:::::A        I::::I    R::::R     R:::::R  E::::::EEEEEEEEEE   
-            S:::::SO:::::O     O:::::O  L:::::L                 I::::I          T:::::T       A:::::::::::::::::::::A       I::::I    R::::R     R:::::R  E:::::E             
-            S:::::SO::::::O   O::::::O  L:::::L         LLLLLL  I::::I          T:::::T      A:::::AAAAAAAAAAAAA:::::A      I::::I    R::::R     R:::::R  E:::::E       EEEEEE
-SSSSSSS     S:::::SO:::::::OOO:::::::OLL:::::::LLLLLLLLL:::::LII::::::II      TT:::::::TT   A:::::A             A:::::A   II::::::IIRR:::::R     R:::::REE::::::EEEEEEEE:::::E
-S::::::SSSSSS:::::S OO:::::::::::::OO L::::::::::::::::::::::LI::::::::I      T:::::::::T  A:::::A               A:::::A  I::::::::IR::::::R     R:::::RE::::::::::::::::::::E
-S:::::::::::::::SS    OO:::::::::OO   L::::::::::::::::::::::LI::::::::I      T:::::::::T A:::::A                 A:::::A I::::::::IR::::::R     R:::::RE::::::::::::::::::::E
- SSSSSSSSSSSSSSS        OOOOOOOOO     LLLLLLLLLLLLLLLLLLLLLLLLIIIIIIIIII      TTTTTTTTTTTAAAAAAA                   AAAAAAAIIIIIIIIIIRRRRRRRR     RRRRRRREEEEEEEEEEEEEEEEEEEEEE
-                                                                                                                                                                              
-                                                                                                                                                                              
-                                                                                                                                                                              
-                                                                                                                                                                              
-                                                                                                                                                                              
-                                                                                                                                                                              
-                                                                                                                                                                              
-
+// Weights of the position evaluation used by the heuristic agent and hints.
+// Tuned values can be loaded from a file written by --tune (see --weights).
+struct EvalWeights {
+    double foundationCard = 10.0;   // per card on the foundations
+    double faceDownCard = -5.0;     // per face-down tableau card
+    double faceDownSquared = 0.0;   // per column, its face-down count squared (favours the deep columns)
+    double emptyColumn = 3.0;       // per empty tableau column
+    double stockCard = -0.5;        // per card still in the stock
+    double wasteCard = -0.5;        // per card in the waste
+    double stockPass = 0.0;         // turning the waste over, against the best other move
+};
 
-    )" << endl;
+// Weight names as they appear in a weights file, in tuning order
+const struct {
+    const char* name;
+    double EvalWeights::* field;
+} EVAL_WEIGHT_FIELDS[] = {
+    { "foundationCard", &EvalWeights::foundationCard },
+    { "faceDownCard", &EvalWeights::faceDownCard },
+    { "faceDownSquared", &EvalWeights::faceDownSquared },
+    { "emptyColumn", &EvalWeights::emptyColumn },
+    { "stockCard", &EvalWeights::stockCard },
+    { "wasteCard", &EvalWeights::wasteCard },
+    { "stockPass", &EvalWeights::stockPass },
+};
+const int EVAL_WEIGHT_COUNT = sizeof(EVAL_WEIGHT_FIELDS) / sizeof(EVAL_WEIGHT_FIELDS[0]);
+
+// Weights used by the heuristic agent and hints; replaced by --weights
+EvalWeights evalWeights;
+string evalWeightsPath;     // file they came from, passed on to worker processes
+
+// Write weights as "name value" lines
+bool saveWeights(const string& path, const EvalWeights& weights) {
+    ostringstream text;
+    text << "# solitaire evaluation weights" << endl << setprecision(9);
+    for (const auto& field : EVAL_WEIGHT_FIELDS) text << field.name << " " << weights.*field.field << endl;
+    string data = text.str();
+    return writeFileAtomically(path, data.data(), data.size());
 }
 
-string toLowerCase(const string& str) {
-    string lowerStr = str;
-    for (size_t i = 0; i < str.size(); ++i) {
-        lowerStr[i] = tolower(str[i]);
+// Read a file written by saveWeights. Weights it does not name keep their defaults;
+// an unknown name or a bad number fails the whole load and leaves weights unchanged.
+bool loadWeights(const string& path, EvalWeights& weights) {
+    ifstream in(path);
+    if (!in) return false;
+    EvalWeights loaded;
+    string line;
+    while (getline(in, line)) {
+        istringstream words(line);
+        string name;
+        double value;
+        if (!(words >> name) || name[0] == '#') continue;
+        if (!(words >> value) || !isfinite(value)) return false;
+        bool known = false;
+        for (const auto& field : EVAL_WEIGHT_FIELDS) {
+            if (name == field.name) {
+                loaded.*field.field = value;
+                known = true;
+            }
+        }
+        if (!known) return false;
     }
-    return lowerStr;
+    weights = loaded;
+    return true;
 }
 
-// Command class to handle game start
-class Command {
-private:
-    game solitaireGame;
-
-    void clearScreen() {
-        system("CLS");
-    }
-
-    // Function to print the game instructions
-    void printInstructions() const {
-        cout << "Welcome to the Solitaire game!" << endl;
-        cout << "Below are the available commands you can use to play the game:" << endl;
-        cout << "-------------------------------------------------------------" << endl;
-        cout << "s            : Draw a card from the stockpile to the wastepile." << endl;
-        cout << "m <src> <dest> <num> : Move 'num' cards from tableau column <src> to tableau column <dest>." << endl;
-        cout << "                       - <src> and <dest> are numbers between 1 and 7 (columns in the tableau)." << endl;
-        cout << "                       - <num> is the number of cards to move." << endl;
-        cout << "                       - Example: 'm 1 3 1' moves the top card from column 1 to column 3." << endl;
-        cout << "w2t <col>    : Move the top card from the wastepile to tableau column <col>." << endl;
-        cout << "                       - <col> is the destination column number (1-7)." << endl;
-        cout << "                       - Example: 'w2t 3' moves the top wastepile card to column 3." << endl;
-        cout << "t2f <src> <foundation> : Move the top card from tableau column <src> to foundation <foundation>." << endl;
-        cout << "                       - <src> is the tableau column (1-7)." << endl;
-        cout << "                       - <foundation> is the foundation pile (1-4)." << endl;
-        cout << "                       - Example: 't2f 1 2' moves the top card from column 1 to foundation 2." << endl;
-        cout << "w2f <foundation> : Move the top card from the wastepile to foundation <foundation>." << endl;
-        cout << "                       - <foundation> is the foundation pile (1-4)." << endl;
-        cout << "                       - Example: 'w2f 1' moves the top wastepile card to foundation 1." << endl;
-        cout << "f2t <foundation> <col> : Move the top card from foundation <foundation> to tableau column <col>." << endl;
-        cout << "                       - <foundation> is the foundation pile (1-4)." << endl;
-        cout << "                       - <col> is the tableau column (1-7)." << endl;
-        cout << "                       - Example: 'f2t 2 3' moves the top card from foundation 2 to column 3." << endl;
-        cout << "z            : Undo the last move." << endl;
-        cout << "exit         : Quit the game." << endl;
-        cout << "-------------------------------------------------------------" << endl;
+// Score a position; higher is better
+double evaluatePosition(const game& position, const EvalWeights& weights) {
+    int emptyColumns = 0, faceDown = 0, faceDownSquared = 0;
+    for (int col = 0; col < 7; ++col) {
+        const doublylinkedlist& column = position.getTableau(col);
+        if (column.getsize() == 0) emptyColumns++;
+        int hidden = 0;
+        for (Node* current = column.getHead(); current != nullptr && !current->val.isFaceUp; current = current->next) hidden++;
+        faceDown += hidden;
+        faceDownSquared += hidden * hidden;
     }
+    return weights.foundationCard * position.foundationCount()
+        + weights.faceDownCard * faceDown
+        + weights.faceDownSquared * faceDownSquared
+        + weights.emptyColumn * emptyColumns
+        + weights.stockCard * position.getStockpile().getsize()
+        + weights.wasteCard * position.getWastepile().getsize();
+}
 
+// A player that picks one of the legal moves of a position
+class Agent {
 public:
-    // Constructor to initialize the game
-    Command() : solitaireGame() {}
-
-    // Function to process user commands
-    void processCommand(string input) {
-        clearScreen();  
+    // Return the index in moves of the chosen move (count is always at least 1)
+    virtual int chooseMove(const game& position, const Move* moves, int count) = 0;
+    virtual ~Agent() {}
+};
 
-        input = toLowerCase(input);
+// Picks a legal move uniformly at random
+class RandomAgent : public Agent {
+    mt19937 random;
+public:
+    explicit RandomAgent(uint32_t seed) : random(seed) {}
 
-        stringstream ss(input);
-        string command;
-        ss >> command;
+    int chooseMove(const game&, const Move*, int count) override {
+        return (int)(random() % count);
+    }
+};
 
-        if (command == "s") {
-            solitaireGame.drawCardFromStockpile();
-        }
-        else if (command == "m") {
-            int srcColumn, destColumn, numOfCards;
-            ss >> srcColumn >> destColumn >> numOfCards;
-            if (srcColumn >= 1 && destColumn >= 1) {
-                solitaireGame.moveCard(srcColumn - 1, destColumn - 1, numOfCards);
-            }
-            else {
-                cout << "Invalid Columns. Please Use Columns 1 To 7." << endl;
-            }
-        }
-        else if (command == "w2t") {
-            int destColumn;
-            ss >> destColumn;
-            if (destColumn >= 1) {
-                solitaireGame.moveFromWasteToTableau(destColumn - 1);
-            }
-            else {
-                cout << "Invalid Column. Please Use Columns 1 To 7." << endl;
-            }
+// Foundation moves first, then moves that turn up a card or play from the waste,
+// otherwise draw
+class GreedyAgent : public Agent {
+    static int priority(const game& position, const Move& move) {
+        switch (move.moveType) {
+        case Move::MoveTableauToFoundation:
+        case Move::MoveWasteToFoundation:
+            return 5;
+        case Move::MoveTableauToTableau: {
+            // Only worth it if it uncovers a face-down card. Emptying a column does not
+            // count: with no lookahead, a King would shuttle between empty columns.
+            const doublylinkedlist& column = position.getTableau(move.srcColumn);
+            Node* below = column.getNodeAt(column.getsize() - move.numOfCards - 1);
+            if (below != nullptr && !below->val.isFaceUp) return 4;
+            return 0;
         }
-        else if (command == "t2f") {
-            int srcColumn, foundationIndex;
-            ss >> srcColumn >> foundationIndex;
-            if (srcColumn >= 1 && foundationIndex >= 1 && foundationIndex <= 4) {
-                solitaireGame.moveFromTableauToFoundation(srcColumn - 1, foundationIndex - 1);
-            }
-            else {
-                cout << "Invalid Column Or Foundation. Please Use Columns 1 To 7 And Foundations 1 To 4." << endl;
-            }
+        case Move::MoveWasteToTableau:
+            return 3;
+        case Move::DrawStockToWaste:
+        case Move::ResetStockFromWaste:
+            return 1;
+        default:
+            return 0;
         }
-        else if (command == "w2f") {
-            int foundationIndex;
-            ss >> foundationIndex;
-            if (foundationIndex >= 1 && foundationIndex <= 4) {
-                solitaireGame.moveFromWasteToFoundation(foundationIndex - 1);
-            }
-            else {
-                cout << "Invalid Foundation Index. Please Use Foundations 1 To 4." << endl;
+    }
+
+public:
+    int chooseMove(const game& position, const Move* moves, int count) override {
+        int best = -1;
+        int bestPriority = 0;
+        for (int i = 0; i < count; ++i) {
+            int p = priority(position, moves[i]);
+            if (p > bestPriority) {
+                best = i;
+                bestPriority = p;
             }
         }
-        else if (command == "f2t") {
-            int foundationIndex, destColumn;
-            ss >> foundationIndex >> destColumn;
-            if (foundationIndex >= 1 && foundationIndex <= 4 && destColumn >= 1) {
-                solitaireGame.moveFromFoundationToTableau(foundationIndex - 1, destColumn - 1);
+        return best >= 0 ? best : 0;
+    }
+};
+
+// Plays each move on a scratch copy and keeps the one with the best evaluation.
+// A non-draw move has to improve on the current position, otherwise it draws,
+// which keeps it from shuffling cards back and forth between equal columns.
+// Turning the waste over costs stockPass, so a negative weight lets a move that
+// is slightly worse than standing still win over another pass through the stock.
+class HeuristicAgent : public Agent {
+    EvalWeights weights;
+    game scratch;
+public:
+    explicit HeuristicAgent(const EvalWeights& w = evalWeights) : weights(w), scratch(0) {}
+
+    int chooseMove(const game& position, const Move* moves, int count) override {
+        scratch = position;
+        scratch.setQuiet(true);     // the copy takes the setting of position
+        double bestScore = evaluatePosition(position, weights);
+        if (position.getStockpile().isempty() && !position.getWastepile().isempty()) bestScore += weights.stockPass;
+        int best = -1;
+        int draw = 0;
+        for (int i = 0; i < count; ++i) {
+            if (moves[i].moveType == Move::DrawStockToWaste || moves[i].moveType == Move::ResetStockFromWaste) {
+                draw = i;
+                continue;
             }
-            else {
-                cout << "Invalid Foundation Or Column. Please Use Foundations 1 To 4 And Columns 1 To 7." << endl;
+            if (!scratch.applyMove(moves[i])) continue;
+            double score = evaluatePosition(scratch, weights);
+            scratch.undoMove();
+            if (score > bestScore) {
+                bestScore = score;
+                best = i;
             }
         }
-        else if (command == "z") {
-            solitaireGame.undoMove();
-        }
+        return best >= 0 ? best : draw;
+    }
+};
 
-        else if (command == "exit") {
-            cout << "Exiting Game." << endl;
-            return;
+// Create an agent by name ("random", "greedy" or "heuristic"); nullptr if unknown
+unique_ptr<Agent> makeAgent(const string& name, uint32_t seed) {
+    if (name == "random") return unique_ptr<Agent>(new RandomAgent(seed));
+    if (name == "greedy") return unique_ptr<Agent>(new GreedyAgent());
+    if (name == "heuristic") return unique_ptr<Agent>(new HeuristicAgent());
+    return nullptr;
+}
+
+// Outcome of playGame
+struct PlayResult {
+    bool won;
+    int moves;
+    int stockPasses;
+};
+
+// Play a game to the end with an agent, applying moves directly instead of going
+// through Command's text parsing. The game stops when it is won, when no move is
+// legal, after maxMoves moves, or after two stock passes with no foundation progress.
+PlayResult playGame(game& g, Agent& agent, int maxMoves = 2000) {
+    Move moves[MAX_MOVES];
+    PlayResult result = { false, 0, 0 };
+    int passesWithoutProgress = 0;
+    int foundationAtPassStart = g.foundationCount();
+
+    g.setQuiet(true);
+    while (result.moves < maxMoves && passesWithoutProgress < 2) {
+        if (g.checkIfGameWon()) {
+            result.won = true;
+            break;
         }
-        else {
-            cout << "UNKNOWN COMMAND: " << command << endl;
+        int count = g.generateMoves(moves);
+        if (count == 0) break;
+
+        const Move& move = moves[agent.chooseMove(g, moves, count)];
+        if (move.moveType == Move::ResetStockFromWaste) {
+            result.stockPasses++;
+            if (g.foundationCount() == foundationAtPassStart) passesWithoutProgress++;
+            else passesWithoutProgress = 0;
+            foundationAtPassStart = g.foundationCount();
         }
+        if (!g.applyMove(move)) break;
+        result.moves++;
+    }
+    if (!result.won) result.won = g.checkIfGameWon();
+    return result;
+}
 
-        printInstructions();
-        solitaireGame.printGameState();
+// Average result of the heuristic agent over a run of deals
+struct TuningScore {
+    double meanCards = 0;   // cards on the foundations at the end; 52 for a win
+    double winRate = 0;
+};
+
+// Play count deals from firstSeed with the heuristic agent on several threads
+TuningScore scoreWeights(const EvalWeights& weights, uint64_t firstSeed, int count, int threads) {
+    atomic<int> nextGame(0);
+    atomic<uint64_t> cards(0), wins(0);
+    auto worker = [&]() {
+        HeuristicAgent agent(weights);
+        while (true) {
+            int n = nextGame.fetch_add(1);
+            if (n >= count) break;
+            game g((uint32_t)(firstSeed + n));
+            PlayResult played = playGame(g, agent);
+            cards += g.foundationCount();
+            if (played.won) wins++;
+        }
+    };
+    vector<thread> pool;
+    for (int i = 1; i < threads; ++i) pool.emplace_back(worker);
+    worker();
+    for (thread& t : pool) t.join();
+
+    TuningScore score;
+    if (count > 0) {
+        score.meanCards = (double)cards / count;
+        score.winRate = (double)wins / count;
+    }
+    return score;
+}
+
+// Tune evalWeights by SPSA (simultaneous perturbation stochastic approximation).
+// Each iteration plays the same fresh deals with every weight nudged up or down at
+// random, then with the opposite nudges, and steps along the difference in
+// results; one iteration costs two batches whatever the number of weights. Every
+// few iterations the weights are scored on a fixed set of held-out deals, and the
+// best set so far is written to weightsPath.
+void runTuning(int iterations, int games, int threads, const string& weightsPath) {
+    const uint64_t VALIDATION_SEED = 1000000000;   // held-out deals, never used for a step
+    const int VALIDATE_EVERY = 10;
+    const double STEP = 0.05;       // first step and nudge sizes, as fractions of each
+    const double NUDGE = 0.1;       // weight's starting magnitude
+    const double STABILITY = iterations / 10.0;
+
+    EvalWeights current = evalWeights;
+    double scale[EVAL_WEIGHT_COUNT];
+    for (int i = 0; i < EVAL_WEIGHT_COUNT; ++i) scale[i] = max(1.0, fabs(current.*EVAL_WEIGHT_FIELDS[i].field));
+
+    auto start = chrono::steady_clock::now();
+    TuningScore best = scoreWeights(current, VALIDATION_SEED, games, threads);
+    EvalWeights bestWeights = current;
+    cout << fixed << setprecision(2) << "START: " << best.meanCards << " CARDS, " << 100 * best.winRate << "% WON." << endl;
+
+    mt19937 random(12345);
+    for (int k = 0; k < iterations; ++k) {
+        // Standard SPSA gain sequences
+        double step = STEP * pow(1 + STABILITY, 0.602) / pow(k + 1 + STABILITY, 0.602);
+        double nudge = NUDGE / pow(k + 1, 0.101);
+        int direction[EVAL_WEIGHT_COUNT];
+        EvalWeights up = current, down = current;
+        for (int i = 0; i < EVAL_WEIGHT_COUNT; ++i) {
+            direction[i] = random() & 1 ? 1 : -1;
+            up.*EVAL_WEIGHT_FIELDS[i].field += nudge * direction[i] * scale[i];
+            down.*EVAL_WEIGHT_FIELDS[i].field -= nudge * direction[i] * scale[i];
+        }
+        uint64_t seed = (uint64_t)k * games;
+        double gradient = (scoreWeights(up, seed, games, threads).meanCards
+            - scoreWeights(down, seed, games, threads).meanCards) / (2 * nudge);
+        // The difference between two batches can be several cards, so a step is
+        // capped at the size of the nudge that measured it
+        double move = max(-nudge, min(nudge, step * gradient));
+        for (int i = 0; i < EVAL_WEIGHT_COUNT; ++i) {
+            current.*EVAL_WEIGHT_FIELDS[i].field += move * direction[i] * scale[i];
+        }
+
+        if ((k + 1) % VALIDATE_EVERY == 0 || k + 1 == iterations) {
+            TuningScore check = scoreWeights(current, VALIDATION_SEED, games, threads);
+            cout << "ITERATION " << k + 1 << ": " << check.meanCards << " CARDS, " << 100 * check.winRate << "% WON";
+            if (check.meanCards > best.meanCards) {
+                best = check;
+                bestWeights = current;
+                cout << " (BEST SO FAR)";
+                if (!saveWeights(weightsPath, bestWeights)) cout << endl << "ERROR: COULD NOT WRITE " << weightsPath << ".";
+            }
+            cout << endl;
+        }
+    }
+
+    if (!saveWeights(weightsPath, bestWeights)) {
+        cout << "ERROR: COULD NOT WRITE " << weightsPath << "." << endl;
+        return;
+    }
+    cout << "BEST: " << best.meanCards << " CARDS, " << 100 * best.winRate << "% WON, IN "
+        << chrono::duration<double>(chrono::steady_clock::now() - start).count() << " SECONDS. WEIGHTS SAVED TO "
+        << weightsPath << ":" << endl << setprecision(4);
+    for (const auto& field : EVAL_WEIGHT_FIELDS) cout << "  " << field.name << " " << bestWeights.*field.field << endl;
+}
+
+// The command that performs a move, e.g. "m 3 5 1" or "t2f 2 1"
+string moveToCommand(const Move& move) {
+    switch (move.moveType) {
+    case Move::MoveTableauToTableau:
+        return "m " + to_string(move.srcColumn + 1) + " " + to_string(move.destColumn + 1) + " " + to_string(move.numOfCards);
+    case Move::MoveWasteToTableau:
+        return "w2t " + to_string(move.destColumn + 1);
+    case Move::MoveWasteToFoundation:
+        return "w2f " + to_string(move.foundationIndex + 1);
+    case Move::MoveTableauToFoundation:
+        return "t2f " + to_string(move.srcColumn + 1) + " " + to_string(move.foundationIndex + 1);
+    case Move::MoveFoundationToTableau:
+        return "f2t " + to_string(move.foundationIndex + 1) + " " + to_string(move.destColumn + 1);
+    default:
+        return "s";
+    }
+}
+
+// Compact text form of a line of play, for 'play' and for sharing solutions.
+// A draw or stock reset is '.'; every other move is two base64url characters
+// holding 12 bits: 1 | src(3) | dest(3) | cards-1(4) for a tableau move, else
+// 0 | type(3) | operands (waste to tableau: dest; waste to foundation: f;
+// tableau to foundation: src(3) f(2); foundation to tableau: f(2) dest(3)).
+const char SOLUTION_ALPHABET[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+
+string encodeSolution(const vector<Move>& moves) {
+    string code;
+    for (const Move& move : moves) {
+        int value;
+        switch (move.moveType) {
+        case Move::MoveTableauToTableau:
+            value = 0x800 | move.srcColumn << 7 | move.destColumn << 4 | (move.numOfCards - 1);
+            break;
+        case Move::MoveWasteToTableau:
+            value = 1 << 8 | move.destColumn;
+            break;
+        case Move::MoveWasteToFoundation:
+            value = 2 << 8 | move.foundationIndex;
+            break;
+        case Move::MoveTableauToFoundation:
+            value = 3 << 8 | move.srcColumn << 2 | move.foundationIndex;
+            break;
+        case Move::MoveFoundationToTableau:
+            value = 4 << 8 | move.foundationIndex << 3 | move.destColumn;
+            break;
+        default:
+            code += '.';
+            continue;
+        }
+        code += SOLUTION_ALPHABET[value >> 6];
+        code += SOLUTION_ALPHABET[value & 63];
+    }
+    return code;
+}
+
+// Parse a string from encodeSolution; false on any character or operand it could not produce
+bool decodeSolution(const char* code, size_t length, vector<Move>& moves) {
+    auto digit = [](char c) -> int {
+        const char* found = strchr(SOLUTION_ALPHABET, c);
+        return c != '\0' && found != nullptr ? (int)(found - SOLUTION_ALPHABET) : -1;
+    };
+    moves.clear();
+    for (size_t i = 0; i < length; ++i) {
+        Move move;
+        if (code[i] == '.') {
+            move.moveType = Move::DrawStockToWaste;
+            moves.push_back(move);
+            continue;
+        }
+        if (i + 1 >= length) return false;
+        int high = digit(code[i]), low = digit(code[i + 1]);
+        if (high < 0 || low < 0) return false;
+        int value = high << 6 | low;
+        i++;
+        if (value & 0x800) {
+            move.moveType = Move::MoveTableauToTableau;
+            move.srcColumn = value >> 7 & 7;
+            move.destColumn = value >> 4 & 7;
+            move.numOfCards = (value & 15) + 1;
+        }
+        else if ((value >> 8) == 1) {
+            move.moveType = Move::MoveWasteToTableau;
+            move.destColumn = value & 0xFF;
+        }
+        else if ((value >> 8) == 2) {
+            move.moveType = Move::MoveWasteToFoundation;
+            move.foundationIndex = value & 0xFF;
+        }
+        else if ((value >> 8) == 3) {
+            move.moveType = Move::MoveTableauToFoundation;
+            move.srcColumn = (value & 0xFF) >> 2;
+            move.foundationIndex = value & 3;
+        }
+        else if ((value >> 8) == 4) {
+            move.moveType = Move::MoveFoundationToTableau;
+            move.foundationIndex = (value & 0xFF) >> 3;
+            move.destColumn = value & 7;
+        }
+        else {
+            return false;
+        }
+        if (move.srcColumn > 6 || move.destColumn > 6 || move.foundationIndex > 3) return false;
+        moves.push_back(move);
+    }
+    return true;
+}
+
+enum SolveStatus {
+    SolveWin,       // solution holds a winning line
+    SolveLoss,      // proven unwinnable
+    SolveUnknown    // node limit reached first
+};
+
+struct SolveResult {
+    SolveStatus status = SolveUnknown;
+    vector<Move> solution;
+    uint64_t nodes = 0;
+    bool cached = false;    // answered from a SolveCache
+};
+
+// Counters from one solver run, for tuning move ordering and pruning. Solvers fill
+// it only when given one (setStats), so normal searches pay nothing.
+struct SearchStats {
+    struct Iteration {
+        int bound;          // IDA*: the f limit; anytime search: the round's node budget
+        uint64_t nodes;
+        double seconds;
+    };
+
+    string solver;
+    SolveStatus status = SolveUnknown;
+    uint64_t nodes = 0;
+    double seconds = 0;
+    vector<uint64_t> nodesAtDepth;
+    uint64_t expanded = 0;              // nodes whose moves were generated
+    uint64_t generated[7] = {};         // child moves by Move::MoveType
+    uint64_t cacheLookups = 0;
+    uint64_t cacheHits = 0;             // position already searched
+    uint64_t cacheCollisions = 0;       // slot held another position / Bloom false positive
+    uint64_t duplicatePrunes = 0;
+    uint64_t forcedMoves = 0;           // nodes cut to a single safe foundation move
+    uint64_t deadlockPrunes = 0;
+    uint64_t boundPrunes = 0;           // IDA*: lower bound over the iteration's limit
+    uint64_t illegalMoves = 0;
+    vector<pair<string, double>> phases;
+    vector<Iteration> iterations;
+
+    void reset(const string& name) {
+        *this = SearchStats();
+        solver = name;
+    }
+
+    void countNode(size_t depth) {
+        if (nodesAtDepth.size() <= depth) nodesAtDepth.resize(depth + 1, 0);
+        nodesAtDepth[depth]++;
+    }
+
+    // Add the counters of another run (of a search made of several solver runs)
+    void merge(const SearchStats& other) {
+        if (nodesAtDepth.size() < other.nodesAtDepth.size()) nodesAtDepth.resize(other.nodesAtDepth.size(), 0);
+        for (size_t depth = 0; depth < other.nodesAtDepth.size(); ++depth) nodesAtDepth[depth] += other.nodesAtDepth[depth];
+        expanded += other.expanded;
+        for (int type = 0; type < 7; ++type) generated[type] += other.generated[type];
+        cacheLookups += other.cacheLookups;
+        cacheHits += other.cacheHits;
+        cacheCollisions += other.cacheCollisions;
+        duplicatePrunes += other.duplicatePrunes;
+        forcedMoves += other.forcedMoves;
+        deadlockPrunes += other.deadlockPrunes;
+        boundPrunes += other.boundPrunes;
+        illegalMoves += other.illegalMoves;
+        for (const auto& phase : other.phases) addPhase(phase.first, phase.second);
+    }
+
+    void addPhase(const string& name, double phaseSeconds) {
+        for (auto& phase : phases) {
+            if (phase.first == name) {
+                phase.second += phaseSeconds;
+                return;
+            }
+        }
+        phases.push_back({ name, phaseSeconds });
+    }
+
+    static double rate(uint64_t part, uint64_t whole) {
+        return whole > 0 ? (double)part / whole : 0.0;
+    }
+
+    string toJson() const {
+        static const char* TYPE_NAMES[7] = { "draw", "tableauToTableau", "wasteToTableau", "wasteToFoundation",
+            "tableauToFoundation", "foundationToTableau", "resetStock" };
+        static const char* STATUS_NAMES[3] = { "win", "loss", "unknown" };
+        ostringstream json;
+        json << setprecision(6);
+        json << "{\n  \"solver\": \"" << solver << "\",\n  \"status\": \"" << STATUS_NAMES[status] << "\",\n"
+            << "  \"nodes\": " << nodes << ",\n  \"seconds\": " << seconds << ",\n"
+            << "  \"nodesPerSecond\": " << (seconds > 0 ? nodes / seconds : 0.0) << ",\n  \"nodesAtDepth\": [";
+        for (size_t depth = 0; depth < nodesAtDepth.size(); ++depth) json << (depth ? ", " : "") << nodesAtDepth[depth];
+        json << "],\n  \"branching\": {";
+        uint64_t total = 0;
+        for (int type = 0; type < 7; ++type) {
+            json << "\"" << TYPE_NAMES[type] << "\": " << rate(generated[type], expanded) << ", ";
+            total += generated[type];
+        }
+        json << "\"total\": " << rate(total, expanded) << "},\n"
+            << "  \"cache\": {\"lookups\": " << cacheLookups << ", \"hits\": " << cacheHits
+            << ", \"hitRate\": " << rate(cacheHits, cacheLookups) << ", \"collisions\": " << cacheCollisions
+            << ", \"collisionRate\": " << rate(cacheCollisions, cacheLookups) << "},\n"
+            << "  \"prunes\": {\"duplicate\": " << duplicatePrunes << ", \"forcedSafeMove\": " << forcedMoves
+            << ", \"deadlock\": " << deadlockPrunes << ", \"bound\": " << boundPrunes << ", \"illegal\": " << illegalMoves << "},\n"
+            << "  \"phases\": {";
+        for (size_t i = 0; i < phases.size(); ++i) json << (i ? ", " : "") << "\"" << phases[i].first << "\": " << phases[i].second;
+        json << "},\n  \"iterations\": [";
+        for (size_t i = 0; i < iterations.size(); ++i) {
+            json << (i ? ", " : "") << "{\"bound\": " << iterations[i].bound << ", \"nodes\": " << iterations[i].nodes
+                << ", \"seconds\": " << iterations[i].seconds << "}";
+        }
+        json << "]\n}\n";
+        return json.str();
+    }
+
+    // One line: solver, outcome, speed, depth reached, mean branching, cache and prune counts
+    string summary() const {
+        uint64_t total = 0;
+        for (uint64_t count : generated) total += count;
+        ostringstream line;
+        line << fixed << setprecision(2) << solver << ": " << (status == SolveWin ? "WIN" : status == SolveLoss ? "LOSS" : "UNKNOWN")
+            << ", " << nodes << " NODES IN " << seconds << " S (" << setprecision(0) << (seconds > 0 ? nodes / seconds : 0.0)
+            << "/S), MAX DEPTH " << (nodesAtDepth.empty() ? 0 : nodesAtDepth.size() - 1) << ", BRANCHING " << setprecision(2)
+            << rate(total, expanded) << ", CACHE HITS " << setprecision(1) << 100 * rate(cacheHits, cacheLookups) << "%, PRUNED "
+            << duplicatePrunes + forcedMoves + deadlockPrunes + boundPrunes;
+        return line.str();
+    }
+};
+
+// Seconds since start, for SearchStats phases
+double secondsSince(chrono::steady_clock::time_point start) {
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+// Default memory cap of one solver's visited set, changed with --solver-memory
+size_t solverMemoryCap = (size_t)256 << 20;
+
+// Set of 64-bit position hashes that stays under a memory cap. Keys live in an
+// open-addressing table of plain words (8 bytes a position instead of a hash-set
+// node). When the table cannot grow within the cap, its keys are sorted and written
+// to an anonymous temporary file as one sequential run. Each run has its own Bloom
+// filter, about ten bits a key, so most lookups of new positions never touch the
+// disk however many keys have spilled. The filters share what the table leaves of
+// the cap: runs are merged once there are too many of them or their filters would
+// not fit, and a merged run gets the largest filter that fits, so past a point the
+// filters only get less precise.
+class VisitedSet {
+    static const int MAX_RUNS = 8;
+    static const int BLOOM_HASHES = 4;
+
+    static const int BLOOM_BITS_PER_KEY = 10;
+
+    struct Run {
+        FILE* file;
+        uint64_t count;
+        vector<uint64_t> bloom;
+    };
+
+    vector<uint64_t> table;    // 0 marks an empty slot
+    size_t used;
+    bool hasZero;              // key 0 is kept outside the table
+    size_t tableLimit;         // most slots the cap allows
+    size_t bloomBudget;        // words of Bloom filter the cap leaves beside the table
+    vector<Run> runs;
+    uint64_t spilledCount;
+    uint64_t falsePositives;   // Bloom filter said maybe, the runs said no
+
+    static size_t slotFor(uint64_t key, size_t mask) {
+        return (size_t)((key ^ (key >> 29)) * 0x9E3779B97F4A7C15ULL >> 7) & mask;
+    }
+
+    // Double hashing on the halves of the key; the key is already a good hash
+    static uint64_t bloomBit(const vector<uint64_t>& bloom, uint64_t key, int i) {
+        uint64_t step = (key >> 32) | 1;
+        return (key + i * step) % (bloom.size() * 64);
+    }
+
+    static bool bloomMayContain(const vector<uint64_t>& bloom, uint64_t key) {
+        for (int i = 0; i < BLOOM_HASHES; ++i) {
+            uint64_t bit = bloomBit(bloom, key, i);
+            if (!(bloom[bit / 64] & (1ULL << (bit % 64)))) return false;
+        }
+        return true;
+    }
+
+    static void bloomAdd(vector<uint64_t>& bloom, uint64_t key) {
+        for (int i = 0; i < BLOOM_HASHES; ++i) {
+            uint64_t bit = bloomBit(bloom, key, i);
+            bloom[bit / 64] |= 1ULL << (bit % 64);
+        }
+    }
+
+    // A filter for this many keys, cut down to maxWords words if needed
+    static vector<uint64_t> bloomFor(uint64_t keys, size_t maxWords) {
+        return vector<uint64_t>(max((size_t)1, min((size_t)(keys * BLOOM_BITS_PER_KEY / 64 + 1), maxWords)), 0);
+    }
+
+    size_t bloomWords() const {
+        size_t words = 0;
+        for (const Run& run : runs) words += run.bloom.size();
+        return words;
+    }
+
+    // Position a run file at a byte offset; plain fseek takes a long, which is
+    // 32 bits on Windows and cannot reach past 2 GB
+    static bool seekTo(FILE* file, uint64_t offset) {
+#ifdef _WIN32
+        return _fseeki64(file, (__int64)offset, SEEK_SET) == 0;
+#else
+        return fseeko(file, (off_t)offset, SEEK_SET) == 0;
+#endif
+    }
+
+    // Returns true if the key was not in the table yet
+    bool tableInsert(uint64_t key) {
+        size_t mask = table.size() - 1;
+        for (size_t slot = slotFor(key, mask); ; slot = (slot + 1) & mask) {
+            if (table[slot] == key) return false;
+            if (table[slot] == 0) {
+                table[slot] = key;
+                used++;
+                return true;
+            }
+        }
+    }
+
+    bool tableContains(uint64_t key) const {
+        size_t mask = table.size() - 1;
+        for (size_t slot = slotFor(key, mask); table[slot] != 0; slot = (slot + 1) & mask) {
+            if (table[slot] == key) return true;
+        }
+        return false;
+    }
+
+    void grow() {
+        vector<uint64_t> old(table.size() * 2, 0);
+        old.swap(table);
+        used = 0;
+        for (uint64_t key : old) {
+            if (key != 0) tableInsert(key);
+        }
+    }
+
+    static bool runContains(const Run& run, uint64_t key) {
+        uint64_t low = 0, high = run.count;
+        while (low < high) {
+            uint64_t mid = low + (high - low) / 2;
+            uint64_t value = 0;
+            if (!seekTo(run.file, mid * sizeof(uint64_t)) || fread(&value, sizeof(value), 1, run.file) != 1) return false;
+            if (value == key) return true;
+            if (value < key) low = mid + 1;
+            else high = mid;
+        }
+        return false;
+    }
+
+    // Write the table out as one sorted run and empty it. The keys are sorted in
+    // place at the front of the table, so spilling needs no second copy of them.
+    void spill() {
+        TRACE_SCOPE("VisitedSet::spill");
+        size_t count = remove(table.begin(), table.end(), 0) - table.begin();
+        fill(table.begin() + count, table.end(), 0);
+        sort(table.begin(), table.begin() + count);
+
+        Run run = { tmpfile(), count, vector<uint64_t>() };
+        if (run.file == nullptr || fwrite(table.data(), sizeof(uint64_t), count, run.file) != count) {
+            // No disk space: keep the keys in memory past the cap rather than lose them
+            // (grow rehashes every key, wherever it sits)
+            if (run.file != nullptr) fclose(run.file);
+            grow();
+            return;
+        }
+        // Make room for this run's filter by merging the runs before it into one
+        // with a smaller filter
+        size_t wanted = min((size_t)(count * BLOOM_BITS_PER_KEY / 64 + 1), bloomBudget / 2);
+        if (!runs.empty() && bloomWords() + wanted > bloomBudget) mergeRuns(bloomBudget - wanted);
+        run.bloom = bloomFor(count, bloomBudget > bloomWords() ? bloomBudget - bloomWords() : 1);
+        for (size_t i = 0; i < count; ++i) bloomAdd(run.bloom, table[i]);
+        spilledCount += count;
+        runs.push_back(move(run));
+        fill(table.begin(), table.begin() + count, 0);
+        used = 0;
+        if ((int)runs.size() >= MAX_RUNS) mergeRuns(bloomBudget);
+    }
+
+    // K-way merge of all runs into one, reading and writing sequentially. The old
+    // filters are freed before the merged one, of at most maxWords words, is built
+    // from the merged file; if the merge fails the runs are left as they were.
+    void mergeRuns(size_t maxWords) {
+        TRACE_SCOPE("VisitedSet::mergeRuns");
+        FILE* merged = tmpfile();
+        if (merged == nullptr) return;
+        vector<uint64_t> heads(runs.size());
+        vector<uint64_t> left(runs.size());
+        for (size_t r = 0; r < runs.size(); ++r) {
+            rewind(runs[r].file);
+            left[r] = runs[r].count;
+            if (left[r] > 0 && fread(&heads[r], sizeof(uint64_t), 1, runs[r].file) != 1) left[r] = 0;
+        }
+        uint64_t written = 0;
+        while (true) {
+            size_t best = runs.size();
+            for (size_t r = 0; r < runs.size(); ++r) {
+                if (left[r] > 0 && (best == runs.size() || heads[r] < heads[best])) best = r;
+            }
+            if (best == runs.size()) break;
+            if (fwrite(&heads[best], sizeof(uint64_t), 1, merged) != 1) {
+                fclose(merged);
+                return;
+            }
+            written++;
+            if (--left[best] > 0 && fread(&heads[best], sizeof(uint64_t), 1, runs[best].file) != 1) left[best] = 0;
+        }
+        for (Run& run : runs) fclose(run.file);
+        runs.clear();
+
+        Run run = { merged, written, bloomFor(written, maxWords) };
+        rewind(merged);
+        uint64_t chunk[4096];
+        size_t got;
+        while ((got = fread(chunk, sizeof(uint64_t), 4096, merged)) > 0) {
+            for (size_t i = 0; i < got; ++i) bloomAdd(run.bloom, chunk[i]);
+        }
+        runs.push_back(move(run));
+    }
+
+public:
+    explicit VisitedSet(size_t memoryCap = solverMemoryCap)
+        : table(1024, 0), used(0), hasZero(false), spilledCount(0), falsePositives(0) {
+        // grow holds the old table beside the new one, so the last doubling needs
+        // one and a half times the final table; the rest of the cap is for filters
+        size_t slots = 1024;
+        while (slots * 2 * sizeof(uint64_t) / 2 * 3 <= memoryCap) slots *= 2;
+        tableLimit = slots;
+        bloomBudget = max((size_t)1, (memoryCap > slots * sizeof(uint64_t) ? memoryCap - slots * sizeof(uint64_t) : 0) / sizeof(uint64_t));
+    }
+
+    ~VisitedSet() {
+        for (Run& run : runs) fclose(run.file);
+    }
+
+    VisitedSet(const VisitedSet&) = delete;
+    VisitedSet& operator=(const VisitedSet&) = delete;
+
+    // Add a key; returns true if it was not in the set yet, like unordered_set::insert
+    bool insert(uint64_t key) {
+        if (key == 0) {
+            bool added = !hasZero;
+            hasZero = true;
+            return added;
+        }
+        if (tableContains(key)) return false;
+        for (const Run& run : runs) {
+            if (!bloomMayContain(run.bloom, key)) continue;
+            if (runContains(run, key)) return false;
+            falsePositives++;
+        }
+        if ((used + 1) * 4 > table.size() * 3) {
+            if (table.size() < tableLimit) grow();
+            else spill();
+        }
+        return tableInsert(key);
+    }
+
+    void clear() {
+        for (Run& run : runs) fclose(run.file);
+        runs.clear();
+        table.assign(1024, 0);
+        used = 0;
+        hasZero = false;
+        spilledCount = 0;
+        falsePositives = 0;
+    }
+
+    uint64_t size() const {
+        return used + spilledCount + (hasZero ? 1 : 0);
+    }
+
+    uint64_t spilled() const {
+        return spilledCount;
+    }
+
+    uint64_t bloomFalsePositives() const {
+        return falsePositives;
+    }
+};
+
+// Depth-first solver over game positions. Moves are applied and undone on a private
+// copy of the position through the normal movers, and a visited set of position
+// hashes keeps it from expanding a position twice. A safe foundation move is played
+// as the only child, decided endgames count as won, and findDeadlock rejects
+// provably dead starts.
+class Solver {
+    struct Frame {
+        size_t begin;    // this node's moves in the arena
+        size_t next;
+        size_t end;
+    };
+
+    game position;
+    VisitedSet visited;
+    vector<Move> arena;
+    vector<Frame> frames;
+    uint64_t nodeLimit;
+    SearchStats* stats;
+    bool hasDeadline;
+    chrono::steady_clock::time_point deadline;
+
+    // Nodes between two looks at the clock when there is a deadline
+    static const uint64_t CLOCK_CHECK_NODES = 64;
+
+    // Order to try moves in; higher first
+    int priority(const Move& move) const {
+        switch (move.moveType) {
+        case Move::MoveTableauToFoundation:
+        case Move::MoveWasteToFoundation:
+            return 6;
+        case Move::MoveTableauToTableau: {
+            const doublylinkedlist& column = position.getTableau(move.srcColumn);
+            Node* below = column.getNodeAt(column.getsize() - move.numOfCards - 1);
+            if (below == nullptr) return 4;        // empties the column
+            if (!below->val.isFaceUp) return 5;    // turns up a card
+            return 1;
+        }
+        case Move::MoveWasteToTableau:
+            return 3;
+        case Move::DrawStockToWaste:
+        case Move::ResetStockFromWaste:
+            return 2;
+        default:
+            return 0;
+        }
+    }
+
+    // Generate this node's children into the arena in search order
+    void pushFrame() {
+        Frame frame;
+        frame.begin = frame.next = arena.size();
+        Move forced;
+        if (position.findSafeFoundationMove(forced)) {
+            arena.push_back(forced);
+            if (stats != nullptr) stats->forcedMoves++;
+        }
+        else {
+            Move moves[MAX_MOVES];
+            int count = position.generateMoves(moves);
+            for (int p = 6; p >= 0; --p) {
+                for (int i = 0; i < count; ++i) {
+                    if (priority(moves[i]) == p) arena.push_back(moves[i]);
+                }
+            }
+        }
+        frame.end = arena.size();
+        if (stats != nullptr) {
+            stats->expanded++;
+            for (size_t i = frame.begin; i < frame.end; ++i) stats->generated[arena[i].moveType]++;
+        }
+        frames.push_back(frame);
+    }
+
+    // Finish the decided endgame and return the whole line from the start
+    void collectSolution(SolveResult& result) {
+        position.finishGame();
+        const MoveStack& history = position.getHistory();
+        result.solution.clear();
+        for (int i = 0; i < history.getsize(); ++i) {
+            result.solution.push_back(Move::decode(history.rawData()[i]));
+        }
+        result.status = SolveWin;
+    }
+
+    // The search proper; solve wraps it to fill the statistics
+    SolveResult search(const game& start) {
+        SolveResult result;
+        GameSnapshot snap;
+        start.saveSnapshot(snap);
+        position.loadSnapshot(snap);
+        visited.clear();
+        arena.clear();
+        frames.clear();
+
+        auto phaseStart = chrono::steady_clock::now();
+        Card stuckCard;
+        bool dead = position.findDeadlock(stuckCard);
+        if (stats != nullptr) {
+            stats->addPhase("deadlockCheck", secondsSince(phaseStart));
+            if (dead) stats->deadlockPrunes++;
+        }
+        if (dead) {
+            result.status = SolveLoss;
+            return result;
+        }
+        if (position.checkIfGameWon() || position.isEndgameDecided()) {
+            collectSolution(result);
+            return result;
+        }
+
+        phaseStart = chrono::steady_clock::now();
+        visited.insert(position.positionHash());
+        if (stats != nullptr) stats->countNode(0);
+        pushFrame();
+        while (!frames.empty()) {
+            Frame& frame = frames.back();
+            if (frame.next == frame.end) {
+                arena.resize(frame.begin);
+                frames.pop_back();
+                if (!frames.empty()) position.undoMove();
+                continue;
+            }
+
+            Move move = arena[frame.next++];
+            if (!position.applyMove(move)) {
+                if (stats != nullptr) stats->illegalMoves++;
+                continue;
+            }
+            if (stats != nullptr) stats->cacheLookups++;
+            if (!visited.insert(position.positionHash())) {
+                if (stats != nullptr) {
+                    stats->cacheHits++;
+                    stats->duplicatePrunes++;
+                }
+                position.undoMove();
+                continue;
+            }
+            if (++result.nodes > nodeLimit || (hasDeadline && result.nodes % CLOCK_CHECK_NODES == 0
+                && chrono::steady_clock::now() >= deadline)) {
+                if (stats != nullptr) stats->addPhase("search", secondsSince(phaseStart));
+                result.status = SolveUnknown;
+                return result;
+            }
+            if (stats != nullptr) stats->countNode(frames.size());
+            if (position.checkIfGameWon() || position.isEndgameDecided()) {
+                if (stats != nullptr) stats->addPhase("search", secondsSince(phaseStart));
+                phaseStart = chrono::steady_clock::now();
+                collectSolution(result);
+                if (stats != nullptr) stats->addPhase("collectSolution", secondsSince(phaseStart));
+                return result;
+            }
+            pushFrame();
+        }
+
+        if (stats != nullptr) stats->addPhase("search", secondsSince(phaseStart));
+        result.status = SolveLoss;
+        return result;
+    }
+
+public:
+    explicit Solver(uint64_t limit = 200000, size_t memoryCap = solverMemoryCap)
+        : position(0), visited(memoryCap), nodeLimit(limit), stats(nullptr), hasDeadline(false) {
+        position.setQuiet(true);
+    }
+
+    // Give up (SolveUnknown) once the clock passes when, as well as at the node limit
+    void setDeadline(chrono::steady_clock::time_point when) {
+        hasDeadline = true;
+        deadline = when;
+    }
+
+    // Collect statistics of every later solve into target (nullptr to stop)
+    void setStats(SearchStats* target) {
+        stats = target;
+    }
+
+    SolveResult solve(const game& start) {
+        TRACE_SCOPE("Solver::solve");
+        if (stats == nullptr) return search(start);
+        stats->reset("dfs");
+        auto began = chrono::steady_clock::now();
+        SolveResult result = search(start);
+        stats->seconds = secondsSince(began);
+        stats->status = result.status;
+        stats->nodes = result.nodes;
+        stats->cacheCollisions = visited.bloomFalsePositives();
+        return result;
+    }
+};
+
+// Answer of solveBefore: a proof when there was time for one, otherwise a guess
+struct AnytimeResult {
+    SolveStatus status = SolveUnknown;  // SolveWin and SolveLoss are proven
+    bool hasMove = false;               // false only when there is no legal move
+    Move move;                          // first move of the win, or the best guess
+    vector<Move> solution;              // the whole winning line when status is SolveWin
+    uint64_t nodes = 0;
+    int rounds = 0;                     // deepening rounds that ran to their budget
+};
+
+// Node budget of the first deepening round; each round has four times the last
+const uint64_t ANYTIME_FIRST_NODES = 2000;
+
+// Time budget of the interactive searches ('hint', 'hint fair' and 'solve'); see --hint-ms
+int hintMillis = 30;
+
+// The search proper behind solveBefore; stats add up the counters of every
+// solver run (probe depths count from the probed move)
+AnytimeResult anytimeSearch(const game& start, chrono::steady_clock::time_point deadline, SearchStats* stats) {
+    AnytimeResult answer;
+    game position(start);
+    position.setQuiet(true);
+    Card stuckCard;
+    if (position.checkIfGameWon()) {
+        answer.status = SolveWin;
+        return answer;
+    }
+    Move moves[MAX_MOVES];
+    int count = position.generateMoves(moves);
+    if (count == 0 || position.findDeadlock(stuckCard)) {
+        answer.status = SolveLoss;
+        return answer;
+    }
+    HeuristicAgent agent;
+    answer.move = moves[agent.chooseMove(position, moves, count)];
+    answer.hasMove = true;
+
+    bool lost[MAX_MOVES] = {};
+    SearchStats run;
+    for (uint64_t budget = ANYTIME_FIRST_NODES; chrono::steady_clock::now() < deadline; budget *= 4) {
+        auto roundStart = chrono::steady_clock::now();
+        uint64_t roundNodes = answer.nodes;
+        auto endRound = [&]() {
+            if (stats != nullptr) {
+                stats->iterations.push_back({ (int)min<uint64_t>(budget, 0x7FFFFFFF), answer.nodes - roundNodes,
+                    secondsSince(roundStart) });
+            }
+        };
+
+        Solver solver(budget);
+        solver.setDeadline(deadline);
+        if (stats != nullptr) solver.setStats(&run);
+        SolveResult result = solver.solve(position);
+        if (stats != nullptr) stats->merge(run);
+        answer.nodes += result.nodes;
+        if (result.status != SolveUnknown) {
+            endRound();
+            answer.status = result.status;
+            if (result.status == SolveWin && !result.solution.empty()) answer.move = result.solution[0];
+            answer.solution = result.solution;
+            return answer;
+        }
+
+        Solver probe(max<uint64_t>(budget / count, 1));
+        probe.setDeadline(deadline);
+        if (stats != nullptr) probe.setStats(&run);
+        Move open[MAX_MOVES];
+        int openCount = 0;
+        bool timedOut = false;
+        for (int i = 0; i < count && !timedOut; ++i) {
+            timedOut = chrono::steady_clock::now() >= deadline;
+            if (lost[i] || timedOut) continue;
+            if (!position.applyMove(moves[i])) {
+                lost[i] = true;
+                continue;
+            }
+            SolveResult child = probe.solve(position);
+            position.undoMove();
+            if (stats != nullptr) stats->merge(run);
+            answer.nodes += child.nodes;
+            if (child.status == SolveWin) {
+                endRound();
+                answer.status = SolveWin;
+                answer.move = moves[i];
+                answer.solution.assign(1, moves[i]);
+                answer.solution.insert(answer.solution.end(), child.solution.begin(), child.solution.end());
+                return answer;
+            }
+            if (child.status == SolveLoss) lost[i] = true;
+            else open[openCount++] = moves[i];
+        }
+        endRound();
+        if (timedOut) break;
+        if (openCount == 0) {
+            // Every move loses
+            answer.status = SolveLoss;
+            return answer;
+        }
+        answer.move = open[agent.chooseMove(position, open, openCount)];
+        answer.rounds++;
+    }
+    return answer;
+}
+
+// Best answer available by deadline, whatever the deal. A guess (the heuristic
+// agent's move) is ready before any search; then rounds of growing node budgets
+// first search the position itself, then give every move not yet proven lost a
+// share of the same budget. A proven win or loss ends the search; otherwise the
+// guess becomes the agent's choice among the moves still open. The solvers watch
+// the deadline themselves, so a round cut short costs at most one clock check.
+// With stats, the search is recorded there as solver "anytime".
+AnytimeResult solveBefore(const game& start, chrono::steady_clock::time_point deadline, SearchStats* stats = nullptr) {
+    TRACE_SCOPE("solveBefore");
+    if (stats == nullptr) return anytimeSearch(start, deadline, nullptr);
+    stats->reset("anytime");
+    auto began = chrono::steady_clock::now();
+    AnytimeResult answer = anytimeSearch(start, deadline, stats);
+    stats->seconds = secondsSince(began);
+    stats->status = answer.status;
+    stats->nodes = answer.nodes;
+    return answer;
+}
+
+// Bounded least-recently-used cache of solver results keyed by position hash.
+// A key describes a position, not how it was reached, so entries stay valid across
+// undo, reload and repeated hints. Wins are stored as the remaining packed moves.
+class SolveCache {
+    struct Entry {
+        uint64_t key;
+        SolveStatus status;
+        vector<uint32_t> solution;
+    };
+
+    size_t capacity;
+    list<Entry> entries;    // most recently used first
+    unordered_map<uint64_t, list<Entry>::iterator> index;
+
+public:
+    explicit SolveCache(size_t maxEntries = 4096) : capacity(maxEntries) {}
+
+    // Look a position up; on a hit the result is copied out and the entry refreshed
+    bool lookup(uint64_t key, SolveResult& result) {
+        auto found = index.find(key);
+        if (found == index.end()) return false;
+        entries.splice(entries.begin(), entries, found->second);
+        const Entry& entry = *found->second;
+        result.status = entry.status;
+        result.nodes = 0;
+        result.cached = true;
+        result.solution.clear();
+        for (uint32_t word : entry.solution) result.solution.push_back(Move::decode(word));
+        return true;
+    }
+
+    void store(uint64_t key, const SolveResult& result) {
+        auto found = index.find(key);
+        if (found != index.end()) {
+            entries.erase(found->second);
+            index.erase(found);
+        }
+        Entry entry;
+        entry.key = key;
+        entry.status = result.status;
+        for (const Move& move : result.solution) entry.solution.push_back(move.encode());
+        entries.push_front(entry);
+        index[key] = entries.begin();
+        if (entries.size() > capacity) {
+            index.erase(entries.back().key);
+            entries.pop_back();
+        }
+    }
+
+    // Store a win for every position along its solution, each with the rest of the
+    // line, so following the hints hits the cache at every step
+    void storeLine(const game& start, const SolveResult& result) {
+        store(start.positionHash(), result);
+        if (result.status != SolveWin) return;
+
+        game line(start);
+        line.setQuiet(true);
+        SolveResult rest;
+        rest.status = SolveWin;
+        for (size_t i = 0; i + 1 < result.solution.size(); ++i) {
+            if (!line.applyMove(result.solution[i])) return;
+            rest.solution.assign(result.solution.begin() + i + 1, result.solution.end());
+            store(line.positionHash(), rest);
+        }
+    }
+
+    size_t size() const {
+        return entries.size();
+    }
+};
+
+// Shortest-solution search: IDA* over game positions, counting every move (draws
+// and stock resets included) as one. The lower bound is the number of cards not
+// yet on a foundation plus the cards still in the stock, plus one for each column
+// that must be broken up by a tableau move: each card needs its own foundation move
+// and each stock card its own draw. Turning a card up is part of the move that
+// uncovers it, so flips cost nothing here. A fixed-size table of
+// positions already reached at the same or a smaller depth in the current
+// iteration cuts duplicate paths; collisions only cost pruning, never
+// correctness, so memory stays at TABLE_SIZE entries however long the search runs.
+class OptimalSolver {
+    struct Entry {
+        uint64_t key;
+        uint16_t depth;
+        uint16_t bound;     // iteration that stored it
+    };
+
+    static const size_t TABLE_SIZE = (size_t)1 << 20;
+    static const int FOUND = -1;
+    static const int ABORTED = -2;
+    static const int NO_BOUND = 0x7FFFFFFF;
+
+    game position;
+    vector<Entry> table;
+    vector<Move> path;
+    uint64_t nodeLimit;
+    uint64_t nodes;
+    SearchStats* stats;
+
+    int lowerBound() const {
+        int bound = 52 - position.foundationCount() + position.getStockpile().getsize();
+        // A column where some card covers a lower card of its own suit needs at least
+        // one tableau move: the upper card cannot reach the foundation first
+        for (int column = 0; column < 7; ++column) {
+            unsigned lowestBySuit[4] = { 14, 14, 14, 14 };
+            for (Node* current = position.getTableau(column).getHead(); current != nullptr; current = current->next) {
+                int suit = current->val.id / 13;
+                if ((unsigned)current->val.rank > lowestBySuit[suit]) {
+                    bound++;
+                    break;
+                }
+                lowestBySuit[suit] = min(lowestBySuit[suit], (unsigned)current->val.rank);
+            }
+        }
+        return bound;
+    }
+
+    // Depth-first search below bound; returns FOUND, ABORTED or the smallest
+    // f = depth + lowerBound that went over the bound (NO_BOUND if none did)
+    int search(int depth, int bound) {
+        int estimate = depth + lowerBound();
+        if (estimate > bound) {
+            if (stats != nullptr) stats->boundPrunes++;
+            return estimate;
+        }
+        if (position.checkIfGameWon()) return FOUND;
+        if (++nodes > nodeLimit) return ABORTED;
+        if (stats != nullptr) stats->countNode(depth);
+
+        uint64_t key = position.positionHash();
+        Entry& entry = table[key & (TABLE_SIZE - 1)];
+        if (entry.key == key && entry.bound == bound && entry.depth <= depth) {
+            if (stats != nullptr) {
+                stats->cacheLookups++;
+                stats->cacheHits++;
+                stats->duplicatePrunes++;
+            }
+            return NO_BOUND;
+        }
+        if (stats != nullptr) {
+            stats->cacheLookups++;
+            if (entry.key != 0 && entry.key != key) stats->cacheCollisions++;
+        }
+        entry.key = key;
+        entry.depth = (uint16_t)depth;
+        entry.bound = (uint16_t)bound;
+
+        Move moves[MAX_MOVES];
+        int count = position.generateMoves(moves);
+        // Foundation moves first: they are the only moves that lower the bound
+        stable_partition(moves, moves + count, [](const Move& move) {
+            return move.moveType == Move::MoveTableauToFoundation || move.moveType == Move::MoveWasteToFoundation;
+        });
+        if (stats != nullptr) {
+            stats->expanded++;
+            for (int i = 0; i < count; ++i) stats->generated[moves[i].moveType]++;
+        }
+
+        int next = NO_BOUND;
+        for (int i = 0; i < count; ++i) {
+            if (!position.applyMove(moves[i])) {
+                if (stats != nullptr) stats->illegalMoves++;
+                continue;
+            }
+            path.push_back(moves[i]);
+            int result = search(depth + 1, bound);
+            if (result == FOUND) return FOUND;
+            path.pop_back();
+            position.undoMove();
+            if (result == ABORTED) return ABORTED;
+            next = min(next, result);
+        }
+        return next;
+    }
+
+public:
+    explicit OptimalSolver(uint64_t limit = 5000000) : position(0), nodeLimit(limit), nodes(0), stats(nullptr) {
+        position.setQuiet(true);
+    }
+
+    // Collect statistics of every later solve into target (nullptr to stop)
+    void setStats(SearchStats* target) {
+        stats = target;
+    }
+
+    // solution is a shortest winning line when status is SolveWin. provenBound is
+    // the length every solution is known to reach (the last completed iteration).
+    SolveResult solve(const game& start, int& provenBound) {
+        TRACE_SCOPE("OptimalSolver::solve");
+        SolveResult result;
+        GameSnapshot snap;
+        start.saveSnapshot(snap);
+        position.loadSnapshot(snap);
+        table.assign(TABLE_SIZE, Entry{ 0, 0, 0 });
+        path.clear();
+        nodes = 0;
+        auto began = chrono::steady_clock::now();
+        if (stats != nullptr) stats->reset("ida*");
+
+        Card stuckCard;
+        provenBound = lowerBound();
+        bool dead = position.findDeadlock(stuckCard);
+        if (stats != nullptr) {
+            stats->addPhase("deadlockCheck", secondsSince(began));
+            if (dead) stats->deadlockPrunes++;
+        }
+        if (dead) {
+            result.status = SolveLoss;
+            if (stats != nullptr) stats->status = SolveLoss;
+            return result;
+        }
+        while (true) {
+            auto iterationStart = chrono::steady_clock::now();
+            uint64_t iterationNodes = nodes;
+            int outcome = search(0, provenBound);
+            if (stats != nullptr) {
+                double iterationSeconds = secondsSince(iterationStart);
+                stats->iterations.push_back({ provenBound, nodes - iterationNodes, iterationSeconds });
+                stats->addPhase("search", iterationSeconds);
+            }
+            if (outcome == FOUND) {
+                result.status = SolveWin;
+                result.solution = path;
+                break;
+            }
+            if (outcome == ABORTED) {
+                result.status = SolveUnknown;
+                break;
+            }
+            if (outcome == NO_BOUND) {
+                result.status = SolveLoss;
+                break;
+            }
+            provenBound = outcome;
+        }
+        result.nodes = nodes;
+        if (stats != nullptr) {
+            stats->status = result.status;
+            stats->nodes = nodes;
+            stats->seconds = secondsSince(began);
+        }
+        return result;
+    }
+};
+
+// Replace every card the player cannot see (face-down tableau cards and the whole
+// stock) with a random arrangement of the same cards. Face-up cards, the waste and
+// the foundations are kept, so the result is a deal consistent with what is known.
+void determinize(const game& source, mt19937& random, game& sample) {
+    GameSnapshot snap;
+    source.saveSnapshot(snap);
+    unsigned char hidden[52];
+    int hiddenCount = 0;
+    for (int i = 0; i < 7; ++i) {
+        for (int n = 0; n < snap.tableauSize[i]; ++n) {
+            if (!(snap.tableau[i][n] & 0x40)) hidden[hiddenCount++] = snap.tableau[i][n];
+        }
+    }
+    for (int n = 0; n < snap.stockSize; ++n) hidden[hiddenCount++] = snap.stock[n];
+
+    shuffle(hidden, hidden + hiddenCount, random);
+
+    // Stock cards can carry a stale face-up flag (a rejected w2t sets it before the
+    // rule check), so the flag is cleared wherever a hidden card lands
+    int next = 0;
+    for (int i = 0; i < 7; ++i) {
+        for (int n = 0; n < snap.tableauSize[i]; ++n) {
+            if (!(snap.tableau[i][n] & 0x40)) snap.tableau[i][n] = hidden[next++] & 0x3F;
+        }
+    }
+    for (int n = 0; n < snap.stockSize; ++n) snap.stock[n] = hidden[next++] & 0x3F;
+    sample.loadSnapshot(snap);
+}
+
+// Sampled outcome of one legal move
+struct MoveEstimate {
+    Move move;
+    int wins = 0;
+    int losses = 0;
+    int samples = 0;     // wins, losses and searches that gave up
+
+    double winRate() const {
+        return samples > 0 ? (double)wins / samples : 0.0;
+    }
+};
+
+// Estimate how often each legal move wins without looking at hidden cards: solve
+// many determinized deals after each move and count the wins. Samples run on
+// several threads and stop early once timeLimitMs has passed. Moves are matched
+// across samples by their command text, which names only visible cards.
+vector<MoveEstimate> estimateMoves(const game& position, int samples, int timeLimitMs, uint64_t nodeLimit, uint32_t seed) {
+    TRACE_SCOPE("estimateMoves");
+    vector<MoveEstimate> estimates;
+    vector<string> commands;
+    Move moves[MAX_MOVES];
+    int count = position.generateMoves(moves);
+    for (int i = 0; i < count; ++i) {
+        string command = moveToCommand(moves[i]);
+        if (find(commands.begin(), commands.end(), command) != commands.end()) continue;
+        MoveEstimate estimate;
+        estimate.move = moves[i];
+        estimates.push_back(estimate);
+        commands.push_back(command);
+    }
+    if (estimates.size() < 2) return estimates;
+
+    auto deadline = chrono::steady_clock::now() + chrono::milliseconds(timeLimitMs);
+    atomic<int> nextSample(0);
+    mutex tallyLock;
+
+    auto worker = [&]() {
+        Solver solver(nodeLimit);
+        solver.setDeadline(deadline);
+        game sample(0);
+        sample.setQuiet(true);
+        while (chrono::steady_clock::now() < deadline) {
+            int index = nextSample.fetch_add(1);
+            if (index >= samples) break;
+            mt19937 random(seed + (uint32_t)index);
+            determinize(position, random, sample);
+
+            Move sampleMoves[MAX_MOVES];
+            int sampleCount = sample.generateMoves(sampleMoves);
+            vector<bool> tried(commands.size(), false);
+            for (int i = 0; i < sampleCount && chrono::steady_clock::now() < deadline; ++i) {
+                size_t which = find(commands.begin(), commands.end(), moveToCommand(sampleMoves[i])) - commands.begin();
+                if (which == commands.size() || tried[which]) continue;
+                tried[which] = true;
+                if (!sample.applyMove(sampleMoves[i])) continue;
+                SolveResult result = solver.solve(sample);
+                sample.undoMove();
+                if (result.status == SolveUnknown && chrono::steady_clock::now() >= deadline) break;   // cut off, not a sample
+
+                lock_guard<mutex> lock(tallyLock);
+                estimates[which].samples++;
+                if (result.status == SolveWin) estimates[which].wins++;
+                else if (result.status == SolveLoss) estimates[which].losses++;
+            }
+        }
+    };
+
+    int threads = max(1, (int)thread::hardware_concurrency());
+    vector<thread> pool;
+    for (int i = 0; i < threads; ++i) pool.emplace_back(worker);
+    for (thread& t : pool) t.join();
+
+    stable_sort(estimates.begin(), estimates.end(), [](const MoveEstimate& a, const MoveEstimate& b) {
+        return a.winRate() > b.winRate();
+    });
+    return estimates;
+}
+
+// Reference deals for the solver regression run (--regress), with the result the
+// default Solver gives for each: easy wins, hard wins found near the node limit,
+// deals findDeadlock rejects at once, and deals the search exhausts without a win
+struct CorpusDeal {
+    uint32_t seed;
+    const char* kind;
+    SolveStatus status;
+    uint32_t solutionLength;
+};
+
+const CorpusDeal REFERENCE_CORPUS[] = {
+    { 102, "easy", SolveWin, 120 },
+    { 175, "easy", SolveWin, 120 },
+    { 106, "easy", SolveWin, 113 },
+    { 119, "easy", SolveWin, 126 },
+    { 45, "easy", SolveWin, 118 },
+    { 111, "easy", SolveWin, 147 },
+    { 138, "medium", SolveWin, 155 },
+    { 268, "medium", SolveWin, 292 },
+    { 235, "hard", SolveWin, 152 },
+    { 297, "hard", SolveWin, 650 },
+    { 79, "hard", SolveWin, 140 },
+    { 303, "hard", SolveWin, 141 },
+    { 161, "hard", SolveWin, 117 },
+    { 347, "hard", SolveWin, 149 },
+    { 4, "dead", SolveLoss, 0 },
+    { 74, "dead", SolveLoss, 0 },
+    { 124, "dead", SolveLoss, 0 },
+    { 26, "lost", SolveLoss, 0 },
+    { 53, "lost", SolveLoss, 0 },
+    { 377, "lost", SolveLoss, 0 },
+};
+
+// Largest resident set of this process so far, in kilobytes (0 where unsupported)
+long peakMemoryKb() {
+#ifndef _WIN32
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) return usage.ru_maxrss;
+#endif
+    return 0;
+}
+
+// Solve the reference corpus and compare against the expected results and, if
+// given, a baseline written by an earlier run. Fails (returns false) when a result
+// differs, when any deal needs more than threshold percent more nodes, or when
+// total time or peak memory grow by more than threshold percent.
+// Baseline file: one "seed nodes microseconds" line per deal, then "peak_kb N".
+bool runRegression(const string& baselinePath, const string& writePath, double threshold) {
+    struct Measured {
+        uint64_t nodes;
+        uint64_t micros;
+    };
+    const int corpusSize = (int)(sizeof(REFERENCE_CORPUS) / sizeof(REFERENCE_CORPUS[0]));
+
+    unordered_map<uint32_t, Measured> baseline;
+    long baselinePeakKb = 0;
+    if (!baselinePath.empty()) {
+        ifstream in(baselinePath);
+        if (!in) {
+            cout << "ERROR: CANNOT READ THE BASELINE " << baselinePath << "." << endl;
+            return false;
+        }
+        string key;
+        while (in >> key) {
+            if (key == "peak_kb") {
+                in >> baselinePeakKb;
+            }
+            else {
+                Measured measured;
+                in >> measured.nodes >> measured.micros;
+                baseline[(uint32_t)strtoul(key.c_str(), nullptr, 10)] = measured;
+            }
+        }
+    }
+
+    bool passed = true;
+    uint64_t totalNodes = 0, totalMicros = 0, baselineMicros = 0;
+    vector<Measured> results;
+    cout << left << setw(6) << "SEED" << setw(8) << "KIND" << setw(8) << "RESULT" << right << setw(7) << "MOVES"
+        << setw(10) << "NODES" << setw(10) << "MS" << setw(12) << "NODES/S" << "  CHECK" << endl;
+    for (int i = 0; i < corpusSize; ++i) {
+        const CorpusDeal& deal = REFERENCE_CORPUS[i];
+        Solver solver;
+        game start(deal.seed);
+        auto solveStart = chrono::steady_clock::now();
+        SolveResult result = solver.solve(start);
+        Measured measured;
+        measured.micros = (uint64_t)chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - solveStart).count();
+        measured.nodes = result.nodes;
+        results.push_back(measured);
+        totalNodes += measured.nodes;
+        totalMicros += measured.micros;
+
+        string check = "OK";
+        if (result.status != deal.status || result.solution.size() != deal.solutionLength) {
+            check = "CHANGED RESULT (EXPECTED " + string(deal.status == SolveWin ? "WIN IN " + to_string(deal.solutionLength) : "LOSS") + ")";
+            passed = false;
+        }
+        else if (baseline.count(deal.seed)) {
+            const Measured& before = baseline[deal.seed];
+            baselineMicros += before.micros;
+            if (measured.nodes > before.nodes * (1 + threshold / 100)) {
+                check = "MORE NODES (WAS " + to_string(before.nodes) + ")";
+                passed = false;
+            }
+            else if (measured.nodes < before.nodes) {
+                check = "FEWER NODES (WAS " + to_string(before.nodes) + ")";
+            }
+        }
+        const char* status = result.status == SolveWin ? "WIN" : result.status == SolveLoss ? "LOSS" : "UNKNOWN";
+        double perSecond = measured.micros > 0 ? measured.nodes * 1e6 / measured.micros : 0;
+        cout << left << setw(6) << deal.seed << setw(8) << deal.kind << setw(8) << status << right << setw(7) << result.solution.size()
+            << setw(10) << measured.nodes << setw(10) << fixed << setprecision(1) << measured.micros / 1000.0
+            << setw(12) << setprecision(0) << perSecond << "  " << check << endl;
+    }
+
+    long peakKb = peakMemoryKb();
+    cout << "TOTAL: " << totalNodes << " NODES IN " << setprecision(1) << totalMicros / 1000.0 << " MS ("
+        << setprecision(0) << (totalMicros > 0 ? totalNodes * 1e6 / totalMicros : 0) << " NODES/S), PEAK MEMORY "
+        << peakKb << " KB." << endl;
+    if (baselineMicros > 0 && totalMicros > baselineMicros * (1 + threshold / 100)) {
+        cout << "REGRESSION: TIME GREW FROM " << setprecision(1) << baselineMicros / 1000.0 << " MS." << endl;
+        passed = false;
+    }
+    if (baselinePeakKb > 0 && peakKb > baselinePeakKb * (1 + threshold / 100)) {
+        cout << "REGRESSION: PEAK MEMORY GREW FROM " << baselinePeakKb << " KB." << endl;
+        passed = false;
+    }
+
+    if (!writePath.empty()) {
+        string text;
+        for (int i = 0; i < corpusSize; ++i) {
+            text += to_string(REFERENCE_CORPUS[i].seed) + " " + to_string(results[i].nodes) + " " + to_string(results[i].micros) + "\n";
+        }
+        text += "peak_kb " + to_string(peakKb) + "\n";
+        if (!writeFileAtomically(writePath, text.data(), text.size())) {
+            cout << "ERROR: COULD NOT WRITE THE BASELINE " << writePath << "." << endl;
+            passed = false;
+        }
+    }
+    cout << (passed ? "REGRESSION CHECK PASSED." : "REGRESSION CHECK FAILED.") << endl;
+    return passed;
+}
+
+// Time a hint (solveBefore with the --hint-ms budget) on the opening position of
+// count deals from firstSeed and report the latency percentiles and how often the
+// answer was a proof. Runs on one thread, as an interactive hint does.
+void runHintLatency(uint64_t firstSeed, uint64_t count) {
+    vector<double> millis;
+    int wins = 0, losses = 0, guesses = 0;
+    for (uint64_t n = 0; n < count; ++n) {
+        game g((uint32_t)(firstSeed + n));
+        auto start = chrono::steady_clock::now();
+        AnytimeResult answer = solveBefore(g, start + chrono::milliseconds(hintMillis));
+        millis.push_back(chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
+        if (answer.status == SolveWin) wins++;
+        else if (answer.status == SolveLoss) losses++;
+        else guesses++;
+    }
+    if (millis.empty()) return;
+    sort(millis.begin(), millis.end());
+    auto percentile = [&](double p) {
+        return millis[min(millis.size() - 1, (size_t)(p * millis.size()))];
+    };
+    cout << fixed << setprecision(2) << "HINT LATENCY OVER " << count << " DEALS WITH A " << hintMillis << " MS BUDGET: P50 "
+        << percentile(0.50) << " MS, P99 " << percentile(0.99) << " MS, MAX " << millis.back() << " MS." << endl;
+    cout << "PROVEN WINS " << wins << ", PROVEN LOSSES " << losses << ", BEST GUESSES " << guesses << "." << endl;
+}
+
+// Vectorized environment that steps many games in lockstep for training.
+// Every pile of every game lives in struct-of-arrays form: element [slot * count + g]
+// of each array belongs to game g, so a step walks each array front to back with no
+// per-game objects or virtual calls. Actions are packed Moves (Move::encode) and are
+// checked with the same rules as the game movers; an illegal action leaves its game
+// unchanged. Cards are stored as encodeCard bytes.
+class BatchEnv {
+public:
+    // Observation per game: 7 x 19 tableau slots, 4 foundation tops, the waste top,
+    // then stock and waste sizes. Slots hold the card id 0-51, HIDDEN_CARD for a
+    // face-down card and EMPTY_SLOT for nothing.
+    static const int OBS_SIZE = 7 * 19 + 4 + 1 + 2;
+    static const int8_t HIDDEN_CARD = 52;
+    static const int8_t EMPTY_SLOT = -1;
+
+    explicit BatchEnv(int count)
+        : n(count),
+          tableau(7 * 19 * count), tableauSize(7 * count),
+          foundationTop(4 * count), foundationSize(4 * count),
+          stock(24 * count), stockSize(count),
+          waste(24 * count), wasteSize(count) {
+        for (int g = 0; g < n; ++g) reset(g, (uint32_t)g);
+    }
+
+    int size() const {
+        return n;
+    }
+
+    // Deal game g from a seed, exactly as game(seed) would
+    void reset(int g, uint32_t seed) {
+        game dealt(seed);
+        GameSnapshot snap;
+        dealt.saveSnapshot(snap);
+        load(g, snap);
+    }
+
+    // Copy a position into game g
+    void load(int g, const GameSnapshot& snap) {
+        for (int col = 0; col < 7; ++col) {
+            tableauSize[col * n + g] = snap.tableauSize[col];
+            for (int row = 0; row < snap.tableauSize[col]; ++row) tab(col, row, g) = snap.tableau[col][row];
+        }
+        for (int f = 0; f < 4; ++f) {
+            foundationSize[f * n + g] = snap.foundationSize[f];
+            // Foundation cards are face up, whatever bit a waste card arrived with
+            foundationTop[f * n + g] = snap.foundationSize[f] ? snap.foundation[f][snap.foundationSize[f] - 1] | 0x40 : 0;
+        }
+        stockSize[g] = snap.stockSize;
+        for (int i = 0; i < snap.stockSize; ++i) stock[i * n + g] = snap.stock[i];
+        wasteSize[g] = snap.wasteSize;
+        for (int i = 0; i < snap.wasteSize; ++i) waste[i * n + g] = snap.waste[i];
+    }
+
+    // Copy game g out as a snapshot, e.g. to continue it in a game object
+    void save(int g, GameSnapshot& snap) const {
+        memset(&snap, 0, sizeof(snap));
+        for (int col = 0; col < 7; ++col) {
+            snap.tableauSize[col] = tableauSize[col * n + g];
+            for (int row = 0; row < snap.tableauSize[col]; ++row) snap.tableau[col][row] = tableau[(col * 19 + row) * n + g];
+        }
+        for (int f = 0; f < 4; ++f) {
+            snap.foundationSize[f] = foundationSize[f * n + g];
+            int suitBase = (foundationTop[f * n + g] & 0x3F) / 13 * 13;
+            for (int i = 0; i < snap.foundationSize[f]; ++i) snap.foundation[f][i] = (unsigned char)((suitBase + i) | 0x40);
+        }
+        snap.stockSize = stockSize[g];
+        for (int i = 0; i < snap.stockSize; ++i) snap.stock[i] = stock[i * n + g];
+        snap.wasteSize = wasteSize[g];
+        for (int i = 0; i < snap.wasteSize; ++i) snap.waste[i] = waste[i * n + g];
+    }
+
+    // Apply actions[g] to every game g. rewards[g] gets +1 for each card moved onto a
+    // foundation, -1 for each card taken off and -0.01 for an illegal action;
+    // done[g] is set once all 52 cards are home.
+    void step(const uint32_t* actions, float* rewards, uint8_t* done) {
+        for (int g = 0; g < n; ++g) {
+            Move move = Move::decode(actions[g]);
+            int gain = 0;
+            bool legal = false;
+            switch (move.moveType) {
+            case Move::DrawStockToWaste:
+            case Move::ResetStockFromWaste:
+                legal = draw(g);
+                break;
+            case Move::MoveTableauToTableau:
+                legal = tableauToTableau(g, move.srcColumn, move.destColumn, move.numOfCards);
+                break;
+            case Move::MoveWasteToTableau:
+                legal = wasteSize[g] > 0 && fitsTableau(g, waste[(wasteSize[g] - 1) * n + g], move.destColumn);
+                if (legal) {
+                    int col = move.destColumn;
+                    tab(col, tableauSize[col * n + g]++, g) = waste[(--wasteSize[g]) * n + g] | 0x40;
+                }
+                break;
+            case Move::MoveWasteToFoundation:
+                legal = wasteSize[g] > 0 && fitsFoundation(g, waste[(wasteSize[g] - 1) * n + g], move.foundationIndex);
+                if (legal) {
+                    pushFoundation(g, move.foundationIndex, waste[(--wasteSize[g]) * n + g]);
+                    gain = 1;
+                }
+                break;
+            case Move::MoveTableauToFoundation: {
+                int col = move.srcColumn;
+                int height = col < 7 ? tableauSize[col * n + g] : 0;
+                legal = col < 7 && height > 0 && fitsFoundation(g, tab(col, height - 1, g), move.foundationIndex);
+                if (legal) {
+                    pushFoundation(g, move.foundationIndex, tab(col, height - 1, g));
+                    tableauSize[col * n + g] = (uint8_t)(height - 1);
+                    flipTop(g, col);
+                    gain = 1;
+                }
+                break;
+            }
+            case Move::MoveFoundationToTableau: {
+                int f = move.foundationIndex;
+                legal = foundationSize[f * n + g] > 0 && fitsTableau(g, foundationTop[f * n + g], move.destColumn);
+                if (legal) {
+                    int col = move.destColumn;
+                    tab(col, tableauSize[col * n + g]++, g) = foundationTop[f * n + g];
+                    if (--foundationSize[f * n + g] > 0) foundationTop[f * n + g]--;
+                    gain = -1;
+                }
+                break;
+            }
+            }
+            rewards[g] = legal ? (float)gain : -0.01f;
+            done[g] = foundationSize[g] + foundationSize[n + g] + foundationSize[2 * n + g] + foundationSize[3 * n + g] == 52;
+        }
+    }
+
+    // Write count x OBS_SIZE observations, game-major, into obs
+    void observe(int8_t* obs) const {
+        for (int col = 0; col < 7; ++col) {
+            for (int row = 0; row < 19; ++row) {
+                const uint8_t* cards = &tableau[(col * 19 + row) * n];
+                const uint8_t* heights = &tableauSize[col * n];
+                int slot = col * 19 + row;
+                for (int g = 0; g < n; ++g) {
+                    obs[g * OBS_SIZE + slot] = row >= heights[g] ? EMPTY_SLOT
+                        : (cards[g] & 0x40) ? (int8_t)(cards[g] & 0x3F) : HIDDEN_CARD;
+                }
+            }
+        }
+        for (int f = 0; f < 4; ++f) {
+            for (int g = 0; g < n; ++g) {
+                obs[g * OBS_SIZE + 133 + f] = foundationSize[f * n + g] ? (int8_t)(foundationTop[f * n + g] & 0x3F) : EMPTY_SLOT;
+            }
+        }
+        for (int g = 0; g < n; ++g) {
+            int8_t* out = obs + g * OBS_SIZE;
+            out[137] = wasteSize[g] ? (int8_t)(waste[(wasteSize[g] - 1) * n + g] & 0x3F) : EMPTY_SLOT;
+            out[138] = (int8_t)stockSize[g];
+            out[139] = (int8_t)wasteSize[g];
+        }
+    }
+
+private:
+    int n;
+    vector<uint8_t> tableau;         // [column * 19 + row][game]
+    vector<uint8_t> tableauSize;     // [column][game]
+    vector<uint8_t> foundationTop;   // [foundation][game]
+    vector<uint8_t> foundationSize;  // [foundation][game]
+    vector<uint8_t> stock;           // [position from bottom][game]
+    vector<uint8_t> stockSize;       // [game]
+    vector<uint8_t> waste;           // [position from bottom][game]
+    vector<uint8_t> wasteSize;       // [game]
+
+    uint8_t& tab(int col, int row, int g) {
+        return tableau[(col * 19 + row) * n + g];
+    }
+
+    // Same rule as the game movers: a King on an empty column, otherwise one rank
+    // lower and the opposite color of the column's top card
+    bool fitsTableau(int g, uint8_t code, int col) {
+        if (col >= 7) return false;
+        Card card = decodeCard(code);
+        int height = tableauSize[col * n + g];
+        if (height == 0) return canMoveToEmptyTableau(card);
+        Card top = decodeCard(tab(col, height - 1, g));
+        return canStackOn(card, top);
+    }
+
+    // An Ace on an empty foundation, otherwise the next rank of the same suit
+    bool fitsFoundation(int g, uint8_t code, int f) {
+        Card card = decodeCard(code);
+        if (foundationSize[f * n + g] == 0) return canStartFoundation(card);
+        Card top = decodeCard(foundationTop[f * n + g]);
+        return canGoOnFoundation(card, top);
+    }
+
+    void pushFoundation(int g, int f, uint8_t code) {
+        foundationTop[f * n + g] = code | 0x40;
+        foundationSize[f * n + g]++;
+    }
+
+    // Turn up the new top card of a column if it is face down
+    void flipTop(int g, int col) {
+        int height = tableauSize[col * n + g];
+        if (height > 0) tab(col, height - 1, g) |= 0x40;
+    }
+
+    // Draw one card, or turn the waste back into the stock when the stock is empty.
+    // Like resetStockpileFromWastepile, the reset keeps the waste's order. With both
+    // empty there is nothing to do, which counts as illegal.
+    bool draw(int g) {
+        if (stockSize[g] > 0) {
+            waste[(wasteSize[g]++) * n + g] = stock[(--stockSize[g]) * n + g];
+            return true;
+        }
+        if (wasteSize[g] == 0) return false;
+        for (int i = 0; i < wasteSize[g]; ++i) stock[i * n + g] = waste[i * n + g];
+        stockSize[g] = wasteSize[g];
+        wasteSize[g] = 0;
+        return true;
+    }
+
+    bool tableauToTableau(int g, int src, int dest, int count) {
+        if (src == dest || src >= 7 || dest >= 7) return false;
+        int height = tableauSize[src * n + g];
+        if (count <= 0 || count > height) return false;
+        int first = height - count;
+        if (!(tab(src, first, g) & 0x40)) return false;
+        for (int row = first; row < height - 1; ++row) {
+            Card lower = decodeCard(tab(src, row, g));
+            Card upper = decodeCard(tab(src, row + 1, g));
+            if (!canStackOn(upper, lower)) return false;
+        }
+        if (!fitsTableau(g, tab(src, first, g), dest)) return false;
+
+        int destHeight = tableauSize[dest * n + g];
+        for (int i = 0; i < count; ++i) tab(dest, destHeight + i, g) = tab(src, first + i, g);
+        tableauSize[dest * n + g] = (uint8_t)(destHeight + count);
+        tableauSize[src * n + g] = (uint8_t)first;
+        flipTop(g, src);
+        return true;
+    }
+};
+
+// Step a BatchEnv of count deals against game objects playing the same actions:
+// mostly legal moves, some made-up ones, with every game reloaded into the
+// environment from its snapshot now and then. Legality, rewards, done flags,
+// positions and tableau observations must all agree. Returns false at the first
+// difference, which is reported.
+bool runEnvCheck(uint64_t firstSeed, int count, int steps) {
+    BatchEnv env(count);
+    vector<game> games;
+    for (int g = 0; g < count; ++g) {
+        env.reset(g, (uint32_t)(firstSeed + g));
+        games.emplace_back((uint32_t)(firstSeed + g));
+        games.back().setQuiet(true);
+    }
+    mt19937 random(12345);
+    vector<uint32_t> actions(count);
+    vector<float> rewards(count);
+    vector<uint8_t> done(count);
+    vector<int8_t> obs((size_t)count * BatchEnv::OBS_SIZE);
+    Move moves[MAX_MOVES];
+    auto homeCards = [](const GameSnapshot& snap) {
+        return snap.foundationSize[0] + snap.foundationSize[1] + snap.foundationSize[2] + snap.foundationSize[3];
+    };
+
+    for (int step = 0; step < steps; ++step) {
+        for (int g = 0; g < count; ++g) {
+            int legalCount = games[g].generateMoves(moves);
+            Move action;
+            if (legalCount > 0 && random() % 5 != 0) {
+                action = moves[random() % legalCount];
+            }
+            else {
+                action.moveType = (Move::MoveType)(random() % 7);
+                action.srcColumn = random() % 8;
+                action.destColumn = random() % 8;
+                action.foundationIndex = random() % 4;
+                action.numOfCards = random() % 14;
+            }
+            actions[g] = action.encode();
+        }
+        env.step(actions.data(), rewards.data(), done.data());
+        env.observe(obs.data());
+
+        for (int g = 0; g < count; ++g) {
+            Move action = Move::decode(actions[g]);
+            GameSnapshot before, expected, faceUp, actual;
+            games[g].saveSnapshot(before);
+            // A draw with the stock and waste both empty does nothing, which the
+            // environment rejects while the game records it as a reset
+            bool idle = (action.moveType == Move::DrawStockToWaste || action.moveType == Move::ResetStockFromWaste)
+                && before.stockSize == 0 && before.wasteSize == 0;
+            bool legal = !idle && games[g].applyMove(action);
+            games[g].saveSnapshot(expected);
+            env.save(g, actual);
+            // The game can leave a card from the waste face down on a foundation;
+            // the environment keeps every foundation card face up
+            faceUp = expected;
+            for (int f = 0; f < 4; ++f) {
+                for (int i = 0; i < faceUp.foundationSize[f]; ++i) faceUp.foundation[f][i] |= 0x40;
+            }
+
+            float reward = legal ? (float)(homeCards(expected) - homeCards(before)) : -0.01f;
+            bool same = rewards[g] == reward && (done[g] != 0) == (homeCards(expected) == 52) && game::sameSnapshot(faceUp, actual);
+            for (int col = 0; col < 7 && same; ++col) {
+                for (int row = 0; row < 19 && same; ++row) {
+                    unsigned char card = expected.tableau[col][row];
+                    int8_t want = row >= expected.tableauSize[col] ? BatchEnv::EMPTY_SLOT
+                        : (card & 0x40) ? (int8_t)(card & 0x3F) : BatchEnv::HIDDEN_CARD;
+                    same = obs[(size_t)g * BatchEnv::OBS_SIZE + col * 19 + row] == want;
+                }
+            }
+            if (!same) {
+                cout << "ENV CHECK FAILED: DEAL " << firstSeed + g << ", STEP " << step + 1 << " (" << moveToCommand(action)
+                    << ", " << (legal ? "LEGAL" : "ILLEGAL") << " IN THE GAME)." << endl;
+                return false;
+            }
+            if (step % 10 == 9) env.load(g, expected);
+        }
+    }
+    cout << "ENV CHECK PASSED: " << (uint64_t)count * steps << " STEPS OVER " << count << " DEALS MATCH THE GAME." << endl;
+    return true;
+}
+
+// One row of batch output
+struct GameResult {
+    uint64_t seed;
+    uint8_t won;
+    uint32_t moveCount;
+    uint8_t cardsToFoundation;
+    uint32_t stockPasses;
+    uint32_t solveMicros;
+};
+
+// Writes batch results from many worker threads without ever blocking them on I/O.
+// Workers append to a front buffer under a short lock; a background thread swaps it
+// with the back buffer and writes that out, so one buffer fills while the other drains.
+//
+// Binary format (little-endian): "SOLR" | uint16 version | uint16 column count, then blocks of
+//   uint32 rows | uint32 payload bytes | payload
+// where the payload holds each column contiguously: seed as zigzag delta varints,
+// won as bytes, moveCount as varints, cardsToFoundation as bytes, stockPasses and
+// solveMicros as varints. The CSV fallback writes one text row per game.
+class ResultWriter {
+    ofstream out;
+    bool csv;
+    vector<GameResult> front;     // filled by workers
+    vector<GameResult> back;      // drained by the writer thread
+    mutex lock;
+    condition_variable wake;
+    condition_variable drained;
+    bool stopping;
+    bool writing;
+    uint64_t bytes;               // file length once everything handed to out is written
+    uint64_t appended;            // rows queued so far
+    uint64_t written;             // rows handed to out so far
+    bool markPending;             // see mark
+    uint64_t markRows;
+    uint64_t markBytes;
+    thread writer;
+
+    static const size_t BLOCK_ROWS = 65536;
+
+    static void putVarint(vector<unsigned char>& bytes, uint64_t value) {
+        while (value >= 0x80) {
+            bytes.push_back((unsigned char)(value | 0x80));
+            value >>= 7;
+        }
+        bytes.push_back((unsigned char)value);
+    }
+
+    void writeBlock(const vector<GameResult>& rows) {
+        if (rows.empty()) return;
+        if (csv) {
+            string text;
+            for (const GameResult& row : rows) {
+                text += to_string(row.seed) + "," + to_string(row.won) + "," + to_string(row.moveCount) + ","
+                    + to_string(row.cardsToFoundation) + "," + to_string(row.stockPasses) + "," + to_string(row.solveMicros) + "\n";
+            }
+            out.write(text.data(), text.size());
+            bytes += text.size();
+            return;
+        }
+
+        vector<unsigned char> payload;
+        payload.reserve(rows.size() * 8);
+        uint64_t previous = 0;
+        for (const GameResult& row : rows) {
+            int64_t delta = (int64_t)(row.seed - previous);
+            putVarint(payload, ((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63));
+            previous = row.seed;
+        }
+        for (const GameResult& row : rows) payload.push_back(row.won);
+        for (const GameResult& row : rows) putVarint(payload, row.moveCount);
+        for (const GameResult& row : rows) payload.push_back(row.cardsToFoundation);
+        for (const GameResult& row : rows) putVarint(payload, row.stockPasses);
+        for (const GameResult& row : rows) putVarint(payload, row.solveMicros);
+
+        uint32_t header[2] = { (uint32_t)rows.size(), (uint32_t)payload.size() };
+        out.write((const char*)header, sizeof(header));
+        out.write((const char*)payload.data(), payload.size());
+        bytes += sizeof(header) + payload.size();
+    }
+
+    void run() {
+        unique_lock<mutex> guard(lock);
+        while (true) {
+            wake.wait(guard, [this] { return stopping || !front.empty(); });
+            if (front.empty() && stopping) break;
+            if (front.size() < BLOCK_ROWS && !stopping) {
+                // Give workers time to fill a whole block before swapping
+                wake.wait_for(guard, chrono::milliseconds(200));
+            }
+            back.swap(front);
+            writing = true;
+            // A mark inside this batch of rows splits it, so the file length at the
+            // mark can be taken once the rows before it are on disk
+            size_t split = markPending && markRows < written + back.size() ? (size_t)(markRows - written) : 0;
+            guard.unlock();
+            if (split > 0) {
+                vector<GameResult> before(back.begin(), back.begin() + split);
+                back.erase(back.begin(), back.begin() + split);
+                writeBlock(before);
+                out.flush();
+                guard.lock();
+                written += split;
+                markBytes = bytes;
+                markPending = false;
+                drained.notify_all();
+                guard.unlock();
+            }
+            writeBlock(back);
+            guard.lock();
+            written += back.size();
+            back.clear();
+            writing = false;
+            if (markPending && written >= markRows) {
+                out.flush();
+                markBytes = bytes;
+                markPending = false;
+            }
+            drained.notify_all();
+        }
+        out.flush();
+    }
+
+public:
+    ResultWriter()
+        : csv(false), stopping(false), writing(false), bytes(0), appended(0), written(0), markPending(false), markRows(0),
+        markBytes(0) {}
+
+    // Open the output file and start the writer thread. A nonzero resumeBytes
+    // continues a file written earlier: anything past that length is cut off and
+    // new rows are appended after it.
+    bool open(const string& path, bool asCsv, uint64_t resumeBytes = 0) {
+        csv = asCsv;
+        if (resumeBytes > 0) {
+            error_code error;
+            if (filesystem::file_size(path, error) < resumeBytes || error) return false;
+            filesystem::resize_file(path, resumeBytes, error);
+            if (error) return false;
+            out.open(path, ios::binary | ios::app);
+            if (!out) return false;
+            bytes = resumeBytes;
+        }
+        else {
+            out.open(path, ios::binary | ios::trunc);
+            if (!out) return false;
+            string header = csv ? "seed,won,moves,foundation_cards,stock_passes,solve_us\n" : "SOLR";
+            if (!csv) {
+                uint16_t versionAndColumns[2] = { 1, 6 };
+                header.append((const char*)versionAndColumns, sizeof(versionAndColumns));
+            }
+            out.write(header.data(), header.size());
+            bytes = header.size();
+        }
+        writer = thread(&ResultWriter::run, this);
+        return true;
+    }
+
+    // Queue one row; never waits for disk
+    void append(const GameResult& row) {
+        bool wakeWriter;
+        {
+            lock_guard<mutex> guard(lock);
+            front.push_back(row);
+            appended++;
+            wakeWriter = front.size() == BLOCK_ROWS;
+        }
+        if (wakeWriter) wake.notify_one();
+    }
+
+    // Block until everything queued so far is on disk; returns the file length
+    uint64_t flush() {
+        unique_lock<mutex> guard(lock);
+        wake.notify_one();
+        drained.wait(guard, [this] { return front.empty() && !writing; });
+        out.flush();
+        return bytes;
+    }
+
+    // Remember the position after the rows queued so far; waitMark returns the file
+    // length there once those rows are on disk. Unlike flush this never waits, so it
+    // can be called under a lock that workers need. One mark at a time.
+    void mark() {
+        lock_guard<mutex> guard(lock);
+        markRows = appended;
+        if (written == appended && !writing) {
+            out.flush();
+            markBytes = bytes;
+            markPending = false;
+            return;
+        }
+        markPending = true;
+        wake.notify_one();
+    }
+
+    uint64_t waitMark() {
+        unique_lock<mutex> guard(lock);
+        drained.wait(guard, [this] { return !markPending; });
+        return markBytes;
+    }
+
+    // Write the remaining rows and stop the writer thread
+    void close() {
+        if (!writer.joinable()) return;
+        {
+            lock_guard<mutex> guard(lock);
+            stopping = true;
+        }
+        wake.notify_one();
+        writer.join();
+        out.close();
+    }
+
+    ~ResultWriter() {
+        close();
+    }
+};
+
+// Progress of a batch run, written atomically every few seconds so an interrupted
+// run can continue where it stopped. Games are handed out in chunks; a chunk counts
+// as done, and its rows reach the output, only when all of its games are played.
+// Layout: BatchCheckpointHeader | one bit per chunk, set when the chunk is done
+struct BatchCheckpointHeader {
+    char magic[4];
+    uint16_t version;
+    uint8_t csv;
+    uint8_t hasBase;
+    uint64_t firstSeed;
+    uint64_t count;
+    uint64_t chunkGames;
+    DealIndex base;
+    char agent[16];
+    // Totals over the done chunks
+    uint64_t played;
+    uint64_t wins;
+    uint64_t deadDeals;
+    uint64_t outputBytes;    // length of the result file holding exactly the done chunks
+};
+
+const char CHECKPOINT_MAGIC[4] = { 'S', 'O', 'L', 'K' };
+const uint16_t CHECKPOINT_VERSION = 1;
+const int CHECKPOINT_SECONDS = 10;
+
+// Games per chunk: small enough for solver runs to checkpoint often
+uint64_t batchChunkGames(bool useSolver) {
+    return useSolver ? 16 : 1024;
+}
+
+bool saveCheckpoint(const string& path, const BatchCheckpointHeader& header, const vector<unsigned char>& done) {
+    vector<char> buffer(sizeof(BatchCheckpointHeader) + done.size());
+    memcpy(&buffer[0], &header, sizeof(BatchCheckpointHeader));
+    if (!done.empty()) memcpy(&buffer[sizeof(BatchCheckpointHeader)], done.data(), done.size());
+    return writeFileAtomically(path, buffer.data(), buffer.size());
+}
+
+// Read a checkpoint written for exactly the same run as expected; false if the
+// file is missing, damaged or belongs to a different run
+bool loadCheckpoint(const string& path, const BatchCheckpointHeader& expected, BatchCheckpointHeader& header, vector<unsigned char>& done) {
+    ifstream in(path, ios::binary);
+    if (!in.read((char*)&header, sizeof(header))) return false;
+    if (memcmp(header.magic, CHECKPOINT_MAGIC, 4) != 0 || header.version != CHECKPOINT_VERSION) return false;
+    if (header.csv != expected.csv || header.hasBase != expected.hasBase || header.firstSeed != expected.firstSeed
+        || header.count != expected.count || header.chunkGames != expected.chunkGames
+        || memcmp(&header.base, &expected.base, sizeof(DealIndex)) != 0
+        || memcmp(header.agent, expected.agent, sizeof(header.agent)) != 0) return false;
+    return (bool)in.read((char*)done.data(), done.size());
+}
+
+// Deal and play game number seed of a batch (see runBatch) with the named agent or
+// the solver. Deals that are provably dead are recorded as losses without being played.
+GameResult playBatchGame(uint64_t seed, const DealIndex* baseIndex, const string& agentName, Solver& solver, bool& dead) {
+    auto gameStart = chrono::steady_clock::now();
+    DealIndex index;
+    if (baseIndex != nullptr) {
+        index = *baseIndex;
+        index.add(seed);
+    }
+    game g = baseIndex != nullptr ? game(index) : game((uint32_t)seed);
+    Card stuckCard;
+    PlayResult played = { false, 0, 0 };
+    // A dead deal needs no search, but the agents still play it: they get cards
+    // home on dead deals too, and their rows should show how many
+    dead = g.findDeadlock(stuckCard);
+    if (agentName == "solver") {
+        if (!dead) {
+            SolveResult solved = solver.solve(g);
+            g.setQuiet(true);
+            for (const Move& move : solved.solution) {
+                g.applyMove(move);
+                if (move.moveType == Move::ResetStockFromWaste) played.stockPasses++;
+            }
+            played.won = solved.status == SolveWin;
+            played.moves = (int)solved.solution.size();
+        }
+    }
+    else {
+        unique_ptr<Agent> agent = makeAgent(agentName, (uint32_t)seed);
+        played = playGame(g, *agent);
+    }
+    GameResult result;
+    result.seed = seed;
+    result.won = played.won ? 1 : 0;
+    result.moveCount = (uint32_t)played.moves;
+    result.stockPasses = (uint32_t)played.stockPasses;
+    result.cardsToFoundation = (uint8_t)g.foundationCount();
+    result.solveMicros = (uint32_t)chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - gameStart).count();
+    return result;
+}
+
+// Deal and play count games starting at firstSeed on several threads with the
+// named agent, streaming one result row per game to outPath. With baseIndex set,
+// game number n is the deal with index baseIndex + n instead of seed n. With a
+// checkpoint path, progress is saved there and a rerun with the same arguments
+// skips the games already played.
+void runBatch(uint64_t firstSeed, uint64_t count, int threads, const string& agentName, const string& outPath, bool csv,
+    const DealIndex* baseIndex = nullptr, const string& checkpointPath = "") {
+    bool useSolver = agentName == "solver";
+    if (!useSolver && !makeAgent(agentName, 0)) {
+        cout << "UNKNOWN AGENT: " << agentName << " (USE random, greedy, heuristic OR solver)." << endl;
+        return;
+    }
+
+    // Stop at the last deal rather than running past 52! - 1
+    auto indexValid = [&](uint64_t seed) {
+        DealIndex index = *baseIndex;
+        index.add(seed);
+        return index < DEAL_COUNT;
+    };
+    if (baseIndex != nullptr && count > 0 && !indexValid(firstSeed + count - 1)) {
+        uint64_t low = 0, high = count - 1;   // count of valid games lies in [low, high]
+        while (low < high) {
+            uint64_t mid = low + (high - low + 1) / 2;
+            if (indexValid(firstSeed + mid - 1)) low = mid;
+            else high = mid - 1;
+        }
+        count = low;
+    }
+
+    BatchCheckpointHeader progress = {};
+    memcpy(progress.magic, CHECKPOINT_MAGIC, 4);
+    progress.version = CHECKPOINT_VERSION;
+    progress.csv = csv ? 1 : 0;
+    progress.hasBase = baseIndex != nullptr ? 1 : 0;
+    progress.firstSeed = firstSeed;
+    progress.count = count;
+    progress.chunkGames = batchChunkGames(useSolver);
+    if (baseIndex != nullptr) progress.base = *baseIndex;
+    strncpy(progress.agent, agentName.c_str(), sizeof(progress.agent) - 1);
+
+    const uint64_t chunkCount = (count + progress.chunkGames - 1) / progress.chunkGames;
+    vector<unsigned char> done((size_t)((chunkCount + 7) / 8), 0);
+    if (!checkpointPath.empty()) {
+        BatchCheckpointHeader saved;
+        vector<unsigned char> savedDone(done.size());
+        if (loadCheckpoint(checkpointPath, progress, saved, savedDone)) {
+            progress = saved;
+            done = savedDone;
+            cout << "RESUMING FROM " << checkpointPath << ": " << progress.played << " OF " << count << " GAMES ALREADY PLAYED." << endl;
+        }
+        else {
+            ifstream existing(checkpointPath);
+            if (existing) {
+                cout << "ERROR: " << checkpointPath << " IS NOT A CHECKPOINT OF THIS RUN." << endl;
+                return;
+            }
+        }
+    }
+    // Chunks finished by an earlier run; read without locking while workers run
+    const vector<unsigned char> doneBefore = done;
+
+    ResultWriter writer;
+    if (!outPath.empty() && !writer.open(outPath, csv, progress.outputBytes)) {
+        cout << "ERROR: COULD NOT OPEN " << outPath << " FOR WRITING." << endl;
+        return;
+    }
+
+    atomic<uint64_t> nextChunk(0);
+    mutex progressLock;
+    condition_variable workersFinished;
+    bool finished = false;
+    auto start = chrono::steady_clock::now();
+
+    auto worker = [&]() {
+        Solver solver;
+        vector<GameResult> rows;
+        while (true) {
+            uint64_t chunk = nextChunk.fetch_add(1);
+            if (chunk >= chunkCount) break;
+            if (doneBefore[chunk / 8] & (1 << (chunk % 8))) continue;
+
+            uint64_t chunkFirst = firstSeed + chunk * progress.chunkGames;
+            uint64_t chunkEnd = min(firstSeed + count, chunkFirst + progress.chunkGames);
+            uint64_t chunkWins = 0, chunkDead = 0;
+            rows.clear();
+            for (uint64_t seed = chunkFirst; seed < chunkEnd; ++seed) {
+                bool dead = false;
+                rows.push_back(playBatchGame(seed, baseIndex, agentName, solver, dead));
+                if (rows.back().won) chunkWins++;
+                if (dead) chunkDead++;
+            }
+
+            lock_guard<mutex> guard(progressLock);
+            if (!outPath.empty()) {
+                for (const GameResult& row : rows) writer.append(row);
+            }
+            done[chunk / 8] |= (unsigned char)(1 << (chunk % 8));
+            progress.played += chunkEnd - chunkFirst;
+            progress.wins += chunkWins;
+            progress.deadDeals += chunkDead;
+        }
+    };
+
+    // Periodic checkpoints get their own thread so no worker waits for the disk.
+    // Under the lock it only copies the progress and marks the output position;
+    // it waits for those rows to reach the disk, and writes the file, without it.
+    auto checkpointer = [&]() {
+        unique_lock<mutex> guard(progressLock);
+        while (!workersFinished.wait_for(guard, chrono::seconds(CHECKPOINT_SECONDS), [&] { return finished; })) {
+            BatchCheckpointHeader snapshot = progress;
+            vector<unsigned char> doneSnapshot = done;
+            if (!outPath.empty()) writer.mark();
+            guard.unlock();
+            // The checkpoint may only claim rows that are already on disk
+            if (!outPath.empty()) snapshot.outputBytes = writer.waitMark();
+            saveCheckpoint(checkpointPath, snapshot, doneSnapshot);
+            guard.lock();
+        }
+    };
+
+    thread checkpointThread;
+    if (!checkpointPath.empty()) checkpointThread = thread(checkpointer);
+    vector<thread> pool;
+    for (int i = 0; i < threads; ++i) pool.emplace_back(worker);
+    for (thread& t : pool) t.join();
+    {
+        lock_guard<mutex> guard(progressLock);
+        finished = true;
+    }
+    workersFinished.notify_one();
+    if (checkpointThread.joinable()) checkpointThread.join();
+    if (!outPath.empty()) progress.outputBytes = writer.flush();
+    writer.close();
+    if (!checkpointPath.empty() && !saveCheckpoint(checkpointPath, progress, done)) {
+        cout << "ERROR: COULD NOT WRITE THE CHECKPOINT " << checkpointPath << "." << endl;
+    }
+
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout << "PLAYED " << progress.played << " GAMES, WON " << progress.wins << " ("
+        << fixed << setprecision(2) << (progress.played ? 100.0 * progress.wins / progress.played : 0.0) << "%) IN "
+        << seconds << " SECONDS; " << progress.deadDeals << " DEALS WERE PROVABLY UNWINNABLE." << endl;
+}
+
+// Recorded games, for checking submitted results. Layout (native byte order):
+//   "SOLG" | uint16 version | uint16 reserved, then per game
+//   DealIndex (4 x uint64) | uint32 move count | uint32 packed move (Move::encode) x count
+const char GAMELOG_MAGIC[4] = { 'S', 'O', 'L', 'G' };
+const uint16_t GAMELOG_VERSION = 1;
+
+// Append a game's deal and moves to a log file, starting the file if needed
+bool appendGameLog(const string& path, const DealIndex& deal, const MoveStack& history) {
+    ifstream existing(path, ios::binary | ios::ate);
+    bool fresh = !existing || existing.tellg() == 0;
+    existing.close();
+
+    vector<char> record;
+    if (fresh) {
+        uint16_t header[2] = { GAMELOG_VERSION, 0 };
+        record.insert(record.end(), GAMELOG_MAGIC, GAMELOG_MAGIC + 4);
+        record.insert(record.end(), (const char*)header, (const char*)header + sizeof(header));
+    }
+    uint32_t count = (uint32_t)history.getsize();
+    record.insert(record.end(), (const char*)&deal, (const char*)&deal + sizeof(DealIndex));
+    record.insert(record.end(), (const char*)&count, (const char*)&count + sizeof(count));
+    record.insert(record.end(), (const char*)history.rawData(), (const char*)(history.rawData() + count));
+
+    ofstream out(path, ios::binary | ios::app);
+    return (bool)out.write(record.data(), record.size());
+}
+
+enum ReplayVerdict : uint8_t {
+    ReplayWon,
+    ReplayIllegalMove,    // moveIndex is the first move the rules reject
+    ReplayNotWon,         // every move was legal but the game is not won
+    ReplayBadDeal         // the deal index is 52! or more
+};
+
+struct ReplayCheck {
+    ReplayVerdict verdict;
+    uint32_t moveIndex;
+};
+
+// Replay a recorded game through the normal movers with all output off; see
+// applyRecordedMove for what makes a move legal here
+ReplayCheck checkReplay(const DealIndex& deal, const uint32_t* moves, uint32_t count) {
+    ReplayCheck check = { ReplayWon, 0 };
+    if (!(deal < DEAL_COUNT)) {
+        check.verdict = ReplayBadDeal;
+        return check;
+    }
+    game g(deal);
+    g.setQuiet(true);
+    for (uint32_t i = 0; i < count; ++i) {
+        uint32_t packed;
+        memcpy(&packed, moves + i, sizeof(packed));    // records are only 4-byte aligned
+        if (!g.applyRecordedMove(packed)) {
+            check.verdict = ReplayIllegalMove;
+            check.moveIndex = i;
+            return check;
+        }
+    }
+    if (!g.checkIfGameWon()) {
+        check.verdict = ReplayNotWon;
+        check.moveIndex = count;
+    }
+    return check;
+}
+
+// Check every game in a log on several threads. Nothing is printed per game: the
+// summary goes to the console and, with outPath, one CSV line per rejected game
+// (its position in the log, the verdict and the move index) goes to outPath.
+void runValidation(const string& logPath, int threads, const string& outPath) {
+    vector<char> buffer;
+    if (!readWholeFile(logPath, buffer) || buffer.size() < 8 || memcmp(buffer.data(), GAMELOG_MAGIC, 4) != 0) {
+        cout << "ERROR: " << logPath << " IS NOT A GAME LOG." << endl;
+        return;
+    }
+    uint16_t version;
+    memcpy(&version, &buffer[4], sizeof(version));
+    if (version != GAMELOG_VERSION) {
+        cout << "ERROR: " << logPath << " HAS UNKNOWN VERSION " << version << "." << endl;
+        return;
+    }
+
+    // One pass to find where each record starts
+    vector<size_t> offsets;
+    size_t cursor = 8;
+    const size_t fixedPart = sizeof(DealIndex) + sizeof(uint32_t);
+    while (buffer.size() - cursor >= fixedPart) {
+        uint32_t count;
+        memcpy(&count, &buffer[cursor + sizeof(DealIndex)], sizeof(count));
+        if ((buffer.size() - cursor - fixedPart) / sizeof(uint32_t) < count) break;
+        offsets.push_back(cursor);
+        cursor += fixedPart + (size_t)count * sizeof(uint32_t);
+    }
+    bool truncated = cursor != buffer.size();
+
+    vector<ReplayCheck> checks(offsets.size());
+    atomic<size_t> nextBlock(0);
+    const size_t BLOCK = 256;
+    auto start = chrono::steady_clock::now();
+    auto worker = [&]() {
+        while (true) {
+            size_t first = nextBlock.fetch_add(1) * BLOCK;
+            if (first >= offsets.size()) break;
+            for (size_t r = first; r < min(first + BLOCK, offsets.size()); ++r) {
+                DealIndex deal;
+                uint32_t count;
+                memcpy(&deal, &buffer[offsets[r]], sizeof(DealIndex));
+                memcpy(&count, &buffer[offsets[r] + sizeof(DealIndex)], sizeof(count));
+                checks[r] = checkReplay(deal, (const uint32_t*)&buffer[offsets[r] + fixedPart], count);
+            }
+        }
+    };
+    vector<thread> pool;
+    for (int i = 0; i < max(1, threads); ++i) pool.emplace_back(worker);
+    for (thread& t : pool) t.join();
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    uint64_t tally[4] = { 0, 0, 0, 0 };
+    string rejected;
+    for (size_t r = 0; r < checks.size(); ++r) {
+        tally[checks[r].verdict]++;
+        if (checks[r].verdict != ReplayWon) {
+            static const char* NAMES[4] = { "won", "illegal_move", "not_won", "bad_deal" };
+            rejected += to_string(r) + "," + NAMES[checks[r].verdict] + "," + to_string(checks[r].moveIndex) + "\n";
+        }
+    }
+    if (!outPath.empty()) {
+        ofstream out(outPath, ios::binary | ios::trunc);
+        out << "game,verdict,move\n" << rejected;
+    }
+
+    cout << "CHECKED " << checks.size() << " GAMES IN " << fixed << setprecision(2) << seconds << " SECONDS: "
+        << tally[ReplayWon] << " WON, " << tally[ReplayIllegalMove] << " WITH AN ILLEGAL MOVE, "
+        << tally[ReplayNotWon] << " NOT WON, " << tally[ReplayBadDeal] << " WITH A BAD DEAL." << endl;
+    if (truncated) cout << "WARNING: THE LOG ENDS WITH A TRUNCATED GAME, WHICH WAS IGNORED." << endl;
+}
+
+#ifndef _WIN32
+// Sweeps split across worker processes. The coordinator listens on a Unix-domain
+// socket, starts local workers (this program run with --worker <socket>) and hands
+// each one shard of consecutive games at a time. Workers may also be started by
+// hand against the same socket. A shard whose worker dies is queued again, and a
+// shard that runs far longer than usual is given to a second, idle worker; the
+// first result to arrive is kept. All messages are fixed-size records in native
+// byte order, since both ends are this same program.
+
+// Coordinator to worker
+struct ShardRequest {
+    uint32_t kind;           // SHARD_PLAY or SHARD_STOP
+    uint32_t hasBase;
+    uint64_t shard;
+    uint64_t firstSeed;
+    uint64_t count;
+    DealIndex base;
+    char agent[16];
+};
+
+// Worker to coordinator, followed by rowCount GameResult records
+struct ShardReply {
+    uint64_t shard;
+    uint64_t wins;
+    uint64_t deadDeals;
+    uint64_t rowCount;
+};
+
+const uint32_t SHARD_PLAY = 1;
+const uint32_t SHARD_STOP = 2;
+const int MAX_RESPAWNS_PER_WORKER = 3;
+
+bool readFully(int fd, void* data, size_t size) {
+    char* cursor = (char*)data;
+    while (size > 0) {
+        ssize_t got = read(fd, cursor, size);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) return false;
+        cursor += got;
+        size -= (size_t)got;
+    }
+    return true;
+}
+
+bool writeFully(int fd, const void* data, size_t size) {
+    const char* cursor = (const char*)data;
+    while (size > 0) {
+        ssize_t sent = write(fd, cursor, size);
+        if (sent < 0 && errno == EINTR) continue;
+        if (sent <= 0) return false;
+        cursor += sent;
+        size -= (size_t)sent;
+    }
+    return true;
+}
+
+bool socketAddress(const string& path, sockaddr_un& address) {
+    if (path.size() >= sizeof(address.sun_path)) return false;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    return true;
+}
+
+// Worker side: play shards until told to stop or the coordinator goes away
+int runWorker(const string& socketPath) {
+    sockaddr_un address;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || !socketAddress(socketPath, address) || connect(fd, (sockaddr*)&address, sizeof(address)) != 0) {
+        cout << "ERROR: COULD NOT CONNECT TO " << socketPath << "." << endl;
+        return 1;
+    }
+    Solver solver;
+    ShardRequest request;
+    vector<GameResult> rows;
+    while (readFully(fd, &request, sizeof(request)) && request.kind == SHARD_PLAY) {
+        string agentName(request.agent, strnlen(request.agent, sizeof(request.agent)));
+        ShardReply reply = { request.shard, 0, 0, request.count };
+        rows.clear();
+        for (uint64_t seed = request.firstSeed; seed < request.firstSeed + request.count; ++seed) {
+            bool dead = false;
+            rows.push_back(playBatchGame(seed, request.hasBase ? &request.base : nullptr, agentName, solver, dead));
+            if (rows.back().won) reply.wins++;
+            if (dead) reply.deadDeals++;
+        }
+        if (!writeFully(fd, &reply, sizeof(reply)) || !writeFully(fd, rows.data(), rows.size() * sizeof(GameResult))) break;
+    }
+    close(fd);
+    return 0;
+}
+
+// Start one local worker; fork + exec keeps the child clear of this process's threads
+pid_t spawnWorker(const string& program, const string& socketPath) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        if (evalWeightsPath.empty()) {
+            execlp(program.c_str(), program.c_str(), "--worker", socketPath.c_str(), (char*)nullptr);
+        }
+        else {
+            execlp(program.c_str(), program.c_str(), "--worker", socketPath.c_str(), "--weights", evalWeightsPath.c_str(),
+                (char*)nullptr);
+        }
+        _exit(127);
+    }
+    return pid;
+}
+
+// Coordinator side: same results as runBatch, spread over worker processes
+void runCoordinator(const string& program, uint64_t firstSeed, uint64_t count, int workers, uint64_t shardGames,
+    const string& agentName, const string& outPath, bool csv, const DealIndex* baseIndex, const string& socketPath) {
+    if (agentName.size() >= sizeof(ShardRequest::agent) || (agentName != "solver" && !makeAgent(agentName, 0))) {
+        cout << "UNKNOWN AGENT: " << agentName << " (USE random, greedy, heuristic OR solver)." << endl;
+        return;
+    }
+    if (baseIndex != nullptr) {
+        DealIndex last = *baseIndex;
+        last.add(firstSeed + count - 1);
+        if (count > 0 && !(last < DEAL_COUNT)) {
+            cout << "ERROR: THE RANGE RUNS PAST THE LAST DEAL." << endl;
+            return;
+        }
+    }
+
+    sockaddr_un address;
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(socketPath.c_str());
+    if (listener < 0 || !socketAddress(socketPath, address) || ::bind(listener, (sockaddr*)&address, sizeof(address)) != 0
+        || listen(listener, 64) != 0) {
+        cout << "ERROR: COULD NOT LISTEN ON " << socketPath << "." << endl;
+        if (listener >= 0) close(listener);
+        return;
+    }
+    signal(SIGPIPE, SIG_IGN);    // a worker that dies mid-write must not take us down
+
+    // Workers are started before the result writer thread exists
+    vector<pid_t> children;
+    for (int i = 0; i < workers; ++i) {
+        pid_t pid = spawnWorker(program, socketPath);
+        if (pid > 0) children.push_back(pid);
+    }
+    int respawnsLeft = workers * MAX_RESPAWNS_PER_WORKER;
+    auto stopWorkers = [&]() {
+        close(listener);
+        unlink(socketPath.c_str());
+        for (pid_t child : children) {
+            if (child > 0) {
+                // Workers keep no state, and one may still be busy on a losing copy or stopped
+                kill(child, SIGKILL);
+                waitpid(child, nullptr, 0);
+            }
+        }
+    };
+
+    ResultWriter writer;
+    if (!outPath.empty() && !writer.open(outPath, csv)) {
+        cout << "ERROR: COULD NOT OPEN " << outPath << " FOR WRITING." << endl;
+        stopWorkers();
+        return;
+    }
+
+    struct Shard {
+        uint64_t firstSeed;
+        uint64_t count;
+        int running = 0;       // workers currently playing it
+        bool done = false;
+    };
+    struct Connection {
+        int fd;
+        long long shard;       // -1 when idle
+        chrono::steady_clock::time_point started;
+    };
+
+    vector<Shard> shards;
+    for (uint64_t first = firstSeed; first < firstSeed + count; first += shardGames) {
+        Shard shard;
+        shard.firstSeed = first;
+        shard.count = min(shardGames, firstSeed + count - first);
+        shards.push_back(shard);
+    }
+    vector<Connection> connections;
+    size_t shardsLeft = shards.size();
+    uint64_t wins = 0, deadDeals = 0, reassigned = 0;
+    double shardSecondsTotal = 0;
+    uint64_t shardsTimed = 0;
+    vector<GameResult> rows;
+    auto start = chrono::steady_clock::now();
+
+    auto assign = [&](Connection& connection, size_t index) {
+        ShardRequest request = {};
+        request.kind = SHARD_PLAY;
+        request.hasBase = baseIndex != nullptr ? 1 : 0;
+        request.shard = index;
+        request.firstSeed = shards[index].firstSeed;
+        request.count = shards[index].count;
+        if (baseIndex != nullptr) request.base = *baseIndex;
+        strncpy(request.agent, agentName.c_str(), sizeof(request.agent) - 1);
+        if (!writeFully(connection.fd, &request, sizeof(request))) return;
+        connection.shard = (long long)index;
+        connection.started = chrono::steady_clock::now();
+        shards[index].running++;
+    };
+
+    // Next shard for an idle worker: an unstarted one, else a copy of the slowest straggler
+    auto pickShard = [&]() -> long long {
+        for (size_t i = 0; i < shards.size(); ++i) {
+            if (!shards[i].done && shards[i].running == 0) return (long long)i;
+        }
+        double average = shardsTimed > 0 ? shardSecondsTotal / shardsTimed : 0;
+        double slowAfter = max(5.0, 4 * average);
+        auto now = chrono::steady_clock::now();
+        long long slowest = -1;
+        double slowestSeconds = slowAfter;
+        for (const Connection& connection : connections) {
+            if (connection.shard < 0 || shards[connection.shard].done || shards[connection.shard].running > 1) continue;
+            double seconds = chrono::duration<double>(now - connection.started).count();
+            if (seconds > slowestSeconds) {
+                slowest = connection.shard;
+                slowestSeconds = seconds;
+            }
+        }
+        if (slowest >= 0) reassigned++;
+        return slowest;
+    };
+
+    auto dropConnection = [&](size_t i) {
+        if (connections[i].shard >= 0) shards[connections[i].shard].running--;
+        close(connections[i].fd);
+        connections.erase(connections.begin() + i);
+    };
+
+    while (shardsLeft > 0) {
+        // Replace local workers that exited
+        for (pid_t& child : children) {
+            int status;
+            if (child > 0 && waitpid(child, &status, WNOHANG) == child) {
+                child = respawnsLeft-- > 0 ? spawnWorker(program, socketPath) : -1;
+            }
+        }
+        bool anyChild = false;
+        for (pid_t child : children) anyChild = anyChild || child > 0;
+        if (!anyChild && connections.empty()) {
+            cout << "ERROR: NO WORKERS LEFT; " << shardsLeft << " SHARDS WERE NOT PLAYED." << endl;
+            break;
+        }
+
+        vector<pollfd> polled(1 + connections.size());
+        polled[0] = { listener, POLLIN, 0 };
+        for (size_t i = 0; i < connections.size(); ++i) polled[i + 1] = { connections[i].fd, POLLIN, 0 };
+        if (poll(polled.data(), polled.size(), 1000) < 0 && errno != EINTR) break;
+
+        if (polled[0].revents & POLLIN) {
+            int fd = accept(listener, nullptr, nullptr);
+            if (fd >= 0) connections.push_back({ fd, -1, chrono::steady_clock::now() });
+        }
+        for (size_t i = connections.size(); i-- > 0;) {
+            if (i + 1 >= polled.size() || !(polled[i + 1].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+            Connection& connection = connections[i];
+            ShardReply reply;
+            if (!readFully(connection.fd, &reply, sizeof(reply)) || reply.shard >= shards.size()
+                || (long long)reply.shard != connection.shard || reply.rowCount != shards[reply.shard].count) {
+                dropConnection(i);    // crashed or confused: its shard goes back in the queue
+                continue;
+            }
+            rows.resize(reply.rowCount);
+            if (!readFully(connection.fd, rows.data(), rows.size() * sizeof(GameResult))) {
+                dropConnection(i);
+                continue;
+            }
+            Shard& shard = shards[reply.shard];
+            shard.running--;
+            connection.shard = -1;
+            if (shard.done) continue;     // the other copy of a reassigned shard got there first
+            shard.done = true;
+            shardsLeft--;
+            wins += reply.wins;
+            deadDeals += reply.deadDeals;
+            shardSecondsTotal += chrono::duration<double>(chrono::steady_clock::now() - connection.started).count();
+            shardsTimed++;
+            if (!outPath.empty()) {
+                for (const GameResult& row : rows) writer.append(row);
+            }
+        }
+
+        for (Connection& connection : connections) {
+            if (connection.shard >= 0) continue;
+            long long next = pickShard();
+            if (next < 0) break;
+            assign(connection, (size_t)next);
+        }
+    }
+
+    ShardRequest stop = {};
+    stop.kind = SHARD_STOP;
+    for (Connection& connection : connections) {
+        writeFully(connection.fd, &stop, sizeof(stop));
+        close(connection.fd);
+    }
+    stopWorkers();
+    writer.close();
+
+    uint64_t played = 0;
+    for (const Shard& shard : shards) {
+        if (shard.done) played += shard.count;
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout << "PLAYED " << played << " GAMES, WON " << wins << " ("
+        << fixed << setprecision(2) << (played ? 100.0 * wins / played : 0.0) << "%) IN "
+        << seconds << " SECONDS; " << deadDeals << " DEALS WERE PROVABLY UNWINNABLE; "
+        << reassigned << " SLOW SHARDS REASSIGNED." << endl;
+}
+#endif
+
+//ascii art
+void displayMainScreen() {
+ 
+    cout << R"(
+
+
+                                                                                                                                                                              
+                                                                                                                                                                              
+   SSSSSSSSSSSSSSS      OOOOOOOOO     LLLLLLLLLLL             IIIIIIIIIITTTTTTTTTTTTTTTTTTTTTTT         AAA               IIIIIIIIIIRRRRRRRRRRRRRRRRR   EEEEEEEEEEEEEEEEEEEEEE
+ SS:::::::::::::::S   OO:::::::::OO   L:::::::::L             I::::::::IT:::::::::::::::::::::T        A:::A              I::::::::IR::::::::::::::::R  E::::::::::::::::::::E
+S:::::SSSSSS::::::S OO:::::::::::::OO L:::::::::L             I::::::::IT:::::::::::::::::::::T       A:::::A             I::::::::IR::::::RRRRRR:::::R E::::::::::::::::::::E
+S:::::S     SSSSSSSO:::::::OOO:::::::OLL:::::::LL             II::::::IIT:::::TT:::::::TT:::::T      A:::::::A            II::::::IIRR:::::R     R:::::REE::::::EEEEEEEEE::::E
+S:::::S            O::::::O   O::::::O  L:::::L                 I::::I  TTTTTT  T:::::T  TTTTTT     A:::::::::A             I::::I    R::::R     R:::::R  E:::::E       EEEEEE
+S:::::S            O:::::O     O:::::O  L:::::L                 I::::I          T:::::T            A:::::A:::::A            I::::I    R::::R     R:::::R  E:::::E             
+ S::::SSSS         O:::::O     O:::::O  L:::::L                 I::::I          T:::::T           A:::::A A:::::A           I::::I    R::::RRRRRR:::::R   E::::::EEEEEEEEEE   
+  SS::::::SSSSS    O:::::O     O:::::O  L:::::L                 I::::I          T:::::T          A:::::A   A:::::A          I::::I    R:::::::::::::RR    E:::::::::::::::E   
+    SSS::::::::SS  O:::::O     O:::::O  L:::::L                 I::::I          T:::::T         A:::::A     A:::::A         I::::I    R::::RRRRRR:::::R   E:::::::::::::::E   
+       SSSSSS::::S O:::::O     O:::::O  L:::::L                 I::::I          T:::::T        A:::::AAAAAAAAA:::::A        I::::I    R::::R     R:::::R  E::::::EEEEEEEEEE   
+            S:::::SO:::::O     O:::::O  L:::::L                 I::::I          T:::::T       A:::::::::::::::::::::A       I::::I    R::::R     R:::::R  E:::::E             
+            S:::::SO::::::O   O::::::O  L:::::L         LLLLLL  I::::I          T:::::T      A:::::AAAAAAAAAAAAA:::::A      I::::I    R::::R     R:::::R  E:::::E       EEEEEE
+SSSSSSS     S:::::SO:::::::OOO:::::::OLL:::::::LLLLLLLLL:::::LII::::::II      TT:::::::TT   A:::::A             A:::::A   II::::::IIRR:::::R     R:::::REE::::::EEEEEEEE:::::E
+S::::::SSSSSS:::::S OO:::::::::::::OO L::::::::::::::::::::::LI::::::::I      T:::::::::T  A:::::A               A:::::A  I::::::::IR::::::R     R:::::RE::::::::::::::::::::E
+S:::::::::::::::SS    OO:::::::::OO   L::::::::::::::::::::::LI::::::::I      T:::::::::T A:::::A                 A:::::A I::::::::IR::::::R     R:::::RE::::::::::::::::::::E
+ SSSSSSSSSSSSSSS        OOOOOOOOO     LLLLLLLLLLLLLLLLLLLLLLLLIIIIIIIIII      TTTTTTTTTTTAAAAAAA                   AAAAAAAIIIIIIIIIIRRRRRRRR     RRRRRRREEEEEEEEEEEEEEEEEEEEEE
+                                                                                                                                                                              
+                                                                                                                                                                              
+                                                                                                                                                                              
+                                                                                                                                                                              
+                                                                                                                                                                              
+                                                                                                                                                                              
+                                                                                                                                                                              
+
+
+    )" << endl;
+}
+
+// Commands understood by the text parser and stored in compiled scripts
+enum CommandOp : uint8_t {
+    OpNone,             // blank line
+    OpUnknown,
+    OpDraw,
+    OpMove,
+    OpWasteToTableau,
+    OpTableauToFoundation,
+    OpWasteToFoundation,
+    OpFoundationToTableau,
+    OpUndo,
+    OpAuto,
+    OpAutoOn,
+    OpAutoOff,
+    OpFinish,
+    OpAnalyze,
+    OpHint,
+    OpSolve,
+    OpSave,
+    OpLoad,
+    OpRun,
+    OpExit,
+    OpDeal,             // new ops go at the end; one with a payload bumps SCRIPT_VERSION
+    OpHintFair,
+    OpLog,
+    OpSolveOptimal,
+    OpPlay,
+    OpStats,
+    OpCount
+};
+
+// Command words and the ops they map to
+const struct {
+    const char* name;
+    CommandOp op;
+} COMMAND_TABLE[] = {
+    { "s", OpDraw },
+    { "m", OpMove },
+    { "w2t", OpWasteToTableau },
+    { "t2f", OpTableauToFoundation },
+    { "w2f", OpWasteToFoundation },
+    { "f2t", OpFoundationToTableau },
+    { "z", OpUndo },
+    { "auto", OpAuto },
+    { "finish", OpFinish },
+    { "analyze", OpAnalyze },
+    { "hint", OpHint },
+    { "solve", OpSolve },
+    { "save", OpSave },
+    { "load", OpLoad },
+    { "run", OpRun },
+    { "deal", OpDeal },
+    { "log", OpLog },
+    { "play", OpPlay },
+    { "stats", OpStats },
+    { "exit", OpExit },
+};
+
+// A parsed command line. The text fields point into the parsed buffer, which must
+// outlive the command; nothing is copied or allocated while parsing.
+struct ParsedCommand {
+    CommandOp op = OpNone;
+    int8_t args[3] = { 0, 0, 0 };     // numbers as typed (1-based), 0 if missing
+    const char* word = nullptr;       // command word as typed, for error messages
+    size_t wordLength = 0;
+    const char* fileName = nullptr;   // save/load/run/log/stats argument, or everything after 'play', as typed
+    size_t fileNameLength = 0;
+    const char* packedMoves = nullptr; // compiled 'play': moveCount words from Move::encode
+    size_t moveCount = 0;
+    int delayMs = 0;
+};
+
+bool isCommandSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+// Case-insensitive comparison of [begin, end) with a lowercase keyword
+bool wordEquals(const char* begin, const char* end, const char* keyword) {
+    for (; begin < end; ++begin, ++keyword) {
+        if (*keyword == '\0' || tolower((unsigned char)*begin) != *keyword) return false;
+    }
+    return *keyword == '\0';
+}
+
+// Advance past spaces, then return the end of the next word
+const char* nextWord(const char*& cursor, const char* end) {
+    while (cursor < end && isCommandSpace(*cursor)) ++cursor;
+    const char* wordEnd = cursor;
+    while (wordEnd < end && !isCommandSpace(*wordEnd)) ++wordEnd;
+    return wordEnd;
+}
+
+// Parse one command line in place
+void parseCommand(const char* line, const char* end, ParsedCommand& command) {
+    command = ParsedCommand();
+    const char* cursor = line;
+    const char* wordEnd = nextWord(cursor, end);
+    if (cursor == wordEnd) return;
+
+    command.word = cursor;
+    command.wordLength = wordEnd - cursor;
+    command.op = OpUnknown;
+    for (const auto& entry : COMMAND_TABLE) {
+        if (wordEquals(cursor, wordEnd, entry.name)) {
+            command.op = entry.op;
+            break;
+        }
+    }
+    cursor = wordEnd;
+
+    switch (command.op) {
+    case OpAuto:
+        wordEnd = nextWord(cursor, end);
+        if (wordEquals(cursor, wordEnd, "on")) command.op = OpAutoOn;
+        else if (wordEquals(cursor, wordEnd, "off")) command.op = OpAutoOff;
+        break;
+    case OpHint:
+        wordEnd = nextWord(cursor, end);
+        if (wordEquals(cursor, wordEnd, "fair")) command.op = OpHintFair;
+        break;
+    case OpSolve:
+        wordEnd = nextWord(cursor, end);
+        if (wordEquals(cursor, wordEnd, "optimal")) command.op = OpSolveOptimal;
+        break;
+    case OpSave:
+    case OpLoad:
+    case OpRun:
+    case OpLog:
+    case OpStats:
+        wordEnd = nextWord(cursor, end);
+        command.fileName = cursor;
+        command.fileNameLength = wordEnd - cursor;
+        break;
+    case OpPlay:
+        // <code> [N] [ms] is split up when it runs
+        while (cursor < end && isCommandSpace(*cursor)) ++cursor;
+        while (end > cursor && isCommandSpace(end[-1])) --end;
+        command.fileName = cursor;
+        command.fileNameLength = end - cursor;
+        break;
+    default:
+        // Up to three integers; anything else ends the argument list
+        for (int i = 0; i < 3; ++i) {
+            wordEnd = nextWord(cursor, end);
+            const char* digit = cursor;
+            bool negative = digit < wordEnd && *digit == '-';
+            if (negative) ++digit;
+            if (digit == wordEnd) break;
+            int value = 0;
+            for (; digit < wordEnd; ++digit) {
+                if (*digit < '0' || *digit > '9') {
+                    value = -1;
+                    break;
+                }
+                if (value < 1000) value = value * 10 + (*digit - '0');
+            }
+            if (value < 0) break;
+            if (negative) value = -value;
+            // Out-of-range numbers become 0, which every command rejects
+            command.args[i] = (int8_t)(value >= -128 && value <= 127 ? value : 0);
+            cursor = wordEnd;
+        }
+        break;
+    }
+}
+
+// Fair hints: determinized deals sampled per hint and the search limit for each.
+// All of them share the interactive time budget (hintMillis).
+const int FAIR_HINT_SAMPLES = 32;
+const uint64_t FAIR_HINT_NODES = 5000;
+
+// Compiled script: "SOLC" | uint16 version | uint16 reserved | uint32 command count, then
+// per command: uint8 op | int8 args[3], followed for ops with text (see hasTextPayload)
+// by uint8 length + text, and for 'play' by uint16 move count | uint16 delay ms |
+// uint32 Move::encode per move. Adding an op with a payload bumps the version, and a
+// reader rejects ops newer than the file's version, so an older binary never reads a
+// payload as records.
+//   1: the ops up to 'hint fair'
+//   2: adds log, play and stats, which carry text
+//   3: play carries its moves packed, so codes are no longer capped at 255 characters
+const char SCRIPT_MAGIC[4] = { 'S', 'O', 'L', 'C' };
+const uint16_t SCRIPT_VERSION = 3;
+
+// First op a file of each version may not contain (indexed by version)
+const CommandOp SCRIPT_OP_END[SCRIPT_VERSION + 1] = { OpNone, OpLog, (CommandOp)(OpStats + 1), (CommandOp)(OpStats + 1) };
+
+// Ops whose compiled record in a file of this version carries text after the arguments
+bool hasTextPayload(CommandOp op, uint16_t version) {
+    return op == OpSave || op == OpLoad || op == OpLog || op == OpStats || (op == OpPlay && version < 3);
+}
+
+// Split the text after 'play' (<code> [N] [ms]) into the first N moves and the delay;
+// false if the code is missing or invalid
+bool parsePlayArguments(const char* text, size_t length, vector<Move>& moves, int& delayMs) {
+    istringstream words(string(text, length));
+    string code;
+    int limit = 0;
+    delayMs = 0;
+    words >> code >> limit >> delayMs;
+    if (code.empty() || !decodeSolution(code.data(), code.size(), moves)) return false;
+    if (limit > 0 && limit < (int)moves.size()) moves.resize(limit);
+    return true;
+}
+
+// True if word is what compileScript stores for a move of a play code; anything
+// else in a compiled play record means the file is corrupt
+bool isPlayMoveWord(uint32_t word) {
+    if ((word >> 16) != 0x7F << 1) return false;  // codes carry no moved card or flip
+    Move move = Move::decode(word);
+    if (move.moveType == Move::MoveTableauToTableau && (move.numOfCards < 1 || move.numOfCards > 16)) return false;
+    string code = encodeSolution(vector<Move>(1, move));
+    vector<Move> moves;
+    return decodeSolution(code.data(), code.size(), moves) && moves.size() == 1 && moves[0].encode() == word;
+}
+
+// Turn a text command script (one command per line) into the compiled format.
+// Returns the number of commands, or -1 with a message in error.
+int compileScript(const string& textPath, const string& outPath, string& error) {
+    vector<char> text;
+    if (!readWholeFile(textPath, text)) {
+        error = "CANNOT READ " + textPath;
+        return -1;
+    }
+
+    vector<char> records;
+    uint32_t count = 0;
+    int lineNumber = 0;
+    const char* cursor = text.data();
+    const char* end = cursor + text.size();
+    while (cursor < end) {
+        const char* lineEnd = cursor;
+        while (lineEnd < end && *lineEnd != '\n') ++lineEnd;
+        lineNumber++;
+
+        ParsedCommand command;
+        parseCommand(cursor, lineEnd, command);
+        cursor = lineEnd + 1;
+        if (command.op == OpNone) continue;
+        vector<Move> moves;
+        int delayMs = 0;
+        bool packed = command.op == OpPlay;
+        if (command.op == OpUnknown || command.op == OpRun || (!packed && command.fileNameLength > 255)
+            || (packed && (!parsePlayArguments(command.fileName, command.fileNameLength, moves, delayMs) || moves.size() > 0xFFFF))) {
+            error = "LINE " + to_string(lineNumber) + ": CANNOT COMPILE '" + string(command.word, command.wordLength) + "'";
+            return -1;
+        }
+
+        records.push_back((char)command.op);
+        for (int i = 0; i < 3; ++i) records.push_back((char)command.args[i]);
+        if (packed) {
+            uint16_t header[2] = { (uint16_t)moves.size(), (uint16_t)min(max(delayMs, 0), 0xFFFF) };
+            records.insert(records.end(), (const char*)header, (const char*)header + sizeof(header));
+            for (const Move& move : moves) {
+                uint32_t word = move.encode();
+                records.insert(records.end(), (const char*)&word, (const char*)&word + sizeof(word));
+            }
+        }
+        else if (hasTextPayload(command.op, SCRIPT_VERSION)) {
+            records.push_back((char)command.fileNameLength);
+            records.insert(records.end(), command.fileName, command.fileName + command.fileNameLength);
+        }
+        count++;
+    }
+
+    ofstream out(outPath, ios::binary | ios::trunc);
+    uint16_t version[2] = { SCRIPT_VERSION, 0 };
+    out.write(SCRIPT_MAGIC, 4);
+    out.write((const char*)version, sizeof(version));
+    out.write((const char*)&count, sizeof(count));
+    out.write(records.data(), records.size());
+    if (!out) {
+        error = "CANNOT WRITE " + outPath;
+        return -1;
+    }
+    return (int)count;
+}
+
+// Command class to handle game start
+class Command {
+private:
+    game solitaireGame;
+    bool autoPlayEnabled;   // run autoPlayToFoundations after every move
+    string autosavePath;    // when set, the game is saved here after every command
+    SolveCache solveCache;  // solver results by position, shared by hint and solve
+    SearchStats lastStats;  // statistics of the last search that ran (not a cache hit)
+    bool quiet;             // suppress command messages (script replay)
+
+    // Stream for command messages; see game::msg
+    ostream& msg() const {
+        static thread_local ostream silent(nullptr);
+        return quiet ? silent : cout;
+    }
+
+    // A cached proof for the current position if there is one, otherwise whatever
+    // solveBefore has within the interactive time budget. Proofs go into the cache.
+    AnytimeResult analyzePosition(bool& cached) {
+        AnytimeResult answer;
+        SolveResult result;
+        cached = solveCache.lookup(solitaireGame.positionHash(), result) && result.status != SolveUnknown;
+        if (cached) {
+            answer.status = result.status;
+            answer.solution = result.solution;
+            answer.hasMove = !result.solution.empty();
+            if (answer.hasMove) answer.move = result.solution[0];
+            return answer;
+        }
+        answer = solveBefore(solitaireGame, chrono::steady_clock::now() + chrono::milliseconds(hintMillis), &lastStats);
+        if (answer.status != SolveUnknown) {
+            result.status = answer.status;
+            result.solution = answer.solution;
+            result.nodes = answer.nodes;
+            solveCache.storeLine(solitaireGame, result);
+        }
+        return answer;
+    }
+
+    void clearScreen() {
+        system("CLS");
+    }
+
+    // Function to print the game instructions
+    void printInstructions() const {
+        cout << "Welcome to the Solitaire game!" << endl;
+        cout << "Below are the available commands you can use to play the game:" << endl;
+        cout << "-------------------------------------------------------------" << endl;
+        cout << "s            : Draw a card from the stockpile to the wastepile." << endl;
+        cout << "m <src> <dest> <num> : Move 'num' cards from tableau column <src> to tableau column <dest>." << endl;
+        cout << "                       - <src> and <dest> are numbers between 1 and 7 (columns in the tableau)." << endl;
+        cout << "                       - <num> is the number of cards to move." << endl;
+        cout << "                       - Example: 'm 1 3 1' moves the top card from column 1 to column 3." << endl;
+        cout << "w2t <col>    : Move the top card from the wastepile to tableau column <col>." << endl;
+        cout << "                       - <col> is the destination column number (1-7)." << endl;
+        cout << "                       - Example: 'w2t 3' moves the top wastepile card to column 3." << endl;
+        cout << "t2f <src> <foundation> : Move the top card from tableau column <src> to foundation <foundation>." << endl;
+        cout << "                       - <src> is the tableau column (1-7)." << endl;
+        cout << "                       - <foundation> is the foundation pile (1-4)." << endl;
+        cout << "                       - Example: 't2f 1 2' moves the top card from column 1 to foundation 2." << endl;
+        cout << "w2f <foundation> : Move the top card from the wastepile to foundation <foundation>." << endl;
+        cout << "                       - <foundation> is the foundation pile (1-4)." << endl;
+        cout << "                       - Example: 'w2f 1' moves the top wastepile card to foundation 1." << endl;
+        cout << "f2t <foundation> <col> : Move the top card from foundation <foundation> to tableau column <col>." << endl;
+        cout << "                       - <foundation> is the foundation pile (1-4)." << endl;
+        cout << "                       - <col> is the tableau column (1-7)." << endl;
+        cout << "                       - Example: 'f2t 2 3' moves the top card from foundation 2 to column 3." << endl;
+        cout << "z            : Undo the last move." << endl;
+        cout << "auto         : Move every card that is safe to move to the foundations." << endl;
+        cout << "auto on/off  : Run 'auto' automatically after each move." << endl;
+        cout << "finish       : Once every card is face up and the stock is empty, move all cards home." << endl;
+        cout << "analyze      : Check whether the position is provably unwinnable." << endl;
+        cout << "hint         : Suggest the next move of a winning line, or a best guess if none is found within" << endl;
+        cout << "                       the time budget (30 ms unless set with --hint-ms)." << endl;
+        cout << "hint fair    : Suggest a move without peeking at face-down or stock cards." << endl;
+        cout << "solve        : Report whether the game can still be won, and in how many moves, or that" << endl;
+        cout << "                       there was no proof either way within the time budget." << endl;
+        cout << "solve optimal: Find the shortest winning line from here (slow early in a game)." << endl;
+        cout << "play <code> [N] [ms] : Play the moves of a code printed by 'solve', or only the first N;" << endl;
+        cout << "                       with ms, show each move for that many milliseconds." << endl;
+        cout << "stats [file] : Show node counts, branching, cache hits and pruning of the last search;" << endl;
+        cout << "                       with a file, also write them there as JSON." << endl;
+        cout << "save <file>  : Save the game, including undo history, to <file>." << endl;
+        cout << "log <file>   : Add this game's deal and moves to the game log <file>, for --validate." << endl;
+        cout << "load <file>  : Load a game saved with 'save'." << endl;
+        cout << "deal         : Show the index of this deal, to replay it with --deal <index>." << endl;
+        cout << "run <file>   : Run the commands in a script file (text or compiled), redrawing once at the end." << endl;
+        cout << "exit         : Quit the game." << endl;
+        cout << "-------------------------------------------------------------" << endl;
+    }
+
+public:
+    // Constructor to initialize the game
+    Command() : solitaireGame(), autoPlayEnabled(false), quiet(false) {}
+
+    // Start over with a specific deal
+    void newGame(const DealIndex& index) {
+        solitaireGame = game(index);
+        solitaireGame.setQuiet(quiet);
+    }
+
+    // Silence the game and command messages, e.g. for headless replays
+    void setQuiet(bool value) {
+        quiet = value;
+        solitaireGame.setQuiet(value);
+    }
+
+    // Resume from a save file and keep saving to it after every command.
+    // A missing file just starts a new game that will be saved there.
+    void resume(const string& path) {
+        autosavePath = path;
+        if (solitaireGame.loadFromFile(path)) {
+            cout << "RESUMED GAME FROM " << path << "." << endl;
+            solitaireGame.printGameState();
+        }
+        else {
+            cout << "NO SAVED GAME IN " << path << ", STARTING A NEW GAME." << endl;
+        }
+    }
+
+    // Carry out one parsed command without redrawing. Returns false for exit.
+    bool execute(const ParsedCommand& command) {
+        const int8_t* args = command.args;
+        int movesBefore = solitaireGame.getHistory().getsize();
+        switch (command.op) {
+        case OpNone:
+            break;
+        case OpDraw:
+            solitaireGame.drawCardFromStockpile();
+            break;
+        case OpMove:
+            if (args[0] >= 1 && args[1] >= 1 && args[2] >= 1) {
+                solitaireGame.moveCard(args[0] - 1, args[1] - 1, args[2]);
+            }
+            else {
+                msg() << "Invalid Columns. Please Use Columns 1 To 7 And Move At Least 1 Card." << endl;
+            }
+            break;
+        case OpWasteToTableau:
+            if (args[0] >= 1) {
+                solitaireGame.moveFromWasteToTableau(args[0] - 1);
+            }
+            else {
+                msg() << "Invalid Column. Please Use Columns 1 To 7." << endl;
+            }
+            break;
+        case OpTableauToFoundation:
+            if (args[0] >= 1 && args[1] >= 1 && args[1] <= 4) {
+                solitaireGame.moveFromTableauToFoundation(args[0] - 1, args[1] - 1);
+            }
+            else {
+                msg() << "Invalid Column Or Foundation. Please Use Columns 1 To 7 And Foundations 1 To 4." << endl;
+            }
+            break;
+        case OpWasteToFoundation:
+            if (args[0] >= 1 && args[0] <= 4) {
+                solitaireGame.moveFromWasteToFoundation(args[0] - 1);
+            }
+            else {
+                msg() << "Invalid Foundation Index. Please Use Foundations 1 To 4." << endl;
+            }
+            break;
+        case OpFoundationToTableau:
+            if (args[0] >= 1 && args[0] <= 4 && args[1] >= 1) {
+                solitaireGame.moveFromFoundationToTableau(args[0] - 1, args[1] - 1);
+            }
+            else {
+                msg() << "Invalid Foundation Or Column. Please Use Foundations 1 To 4 And Columns 1 To 7." << endl;
+            }
+            break;
+        case OpUndo:
+            solitaireGame.undoMove();
+            break;
+        case OpAuto: {
+            int moved = solitaireGame.autoPlayToFoundations();
+            msg() << "AUTO-PLAYED " << moved << " CARD(S) TO THE FOUNDATIONS." << endl;
+            break;
+        }
+        case OpAutoOn:
+            autoPlayEnabled = true;
+            msg() << "AUTO-PLAY ENABLED." << endl;
+            break;
+        case OpAutoOff:
+            autoPlayEnabled = false;
+            msg() << "AUTO-PLAY DISABLED." << endl;
+            break;
+        case OpFinish:
+            if (solitaireGame.isEndgameDecided()) {
+                int moved = solitaireGame.finishGame();
+                msg() << "FINISHED: MOVED " << moved << " CARD(S) TO THE FOUNDATIONS." << endl;
+            }
+            else {
+                msg() << "FINISH IS ONLY AVAILABLE WHEN THE STOCK AND WASTE ARE EMPTY AND EVERY CARD IS FACE UP." << endl;
+            }
+            break;
+        case OpAnalyze: {
+            Card stuckCard;
+            if (solitaireGame.findDeadlock(stuckCard)) {
+                msg() << "UNWINNABLE: " << stuckCard.rank << stuckCard.suit
+                    << " CAN NEVER LEAVE ITS COLUMN (EVERYTHING IT NEEDS IS BURIED UNDER IT OR UNDER CARDS LIKE IT)." << endl;
+            }
+            else {
+                msg() << "NO DEADLOCK FOUND (THE GAME MAY STILL BE UNWINNABLE)." << endl;
+            }
+            break;
+        }
+        case OpHint: {
+            bool cached;
+            AnytimeResult answer = analyzePosition(cached);
+            if (answer.status == SolveUnknown) {
+                msg() << "HINT: " << moveToCommand(answer.move) << " (BEST GUESS; NO WIN FOUND WITHIN "
+                    << hintMillis << " MS)" << endl;
+            }
+            else if (answer.status == SolveWin && answer.hasMove) {
+                msg() << "HINT: " << moveToCommand(answer.move) << endl;
+            }
+            else if (answer.status == SolveWin) {
+                msg() << "THE GAME IS ALREADY WON." << endl;
+            }
+            else {
+                msg() << "NO WINNING LINE EXISTS FROM THIS POSITION." << endl;
+            }
+            break;
+        }
+        case OpHintFair: {
+            vector<MoveEstimate> estimates = estimateMoves(solitaireGame, FAIR_HINT_SAMPLES, hintMillis,
+                FAIR_HINT_NODES, (uint32_t)time(0));
+            if (estimates.empty()) {
+                msg() << "NO LEGAL MOVES." << endl;
+            }
+            else if (estimates.size() == 1) {
+                msg() << "HINT: " << moveToCommand(estimates[0].move) << " (THE ONLY LEGAL MOVE)" << endl;
+            }
+            else {
+                msg() << "HINT: " << moveToCommand(estimates[0].move) << endl;
+                msg() << "ESTIMATED WIN CHANCE PER MOVE (HIDDEN CARDS SAMPLED, NOT READ):" << endl;
+                for (const MoveEstimate& estimate : estimates) {
+                    msg() << "  " << left << setw(10) << moveToCommand(estimate.move) << right
+                        << setw(5) << fixed << setprecision(1) << estimate.winRate() * 100 << "%  ("
+                        << estimate.wins << " WON, " << estimate.losses << " LOST, "
+                        << estimate.samples - estimate.wins - estimate.losses << " UNDECIDED)" << endl;
+                }
+            }
+            break;
+        }
+        case OpSolve: {
+            bool cached;
+            AnytimeResult answer = analyzePosition(cached);
+            string searched = cached ? "FROM CACHE" : to_string(answer.nodes) + " POSITIONS SEARCHED";
+            if (answer.status == SolveWin) {
+                msg() << "WINNABLE IN " << answer.solution.size() << " MOVES (" << searched << ")." << endl;
+                msg() << "PLAY " << encodeSolution(answer.solution) << endl;
+            }
+            else if (answer.status == SolveLoss) {
+                msg() << "UNWINNABLE (" << searched << ")." << endl;
+            }
+            else {
+                msg() << "UNKNOWN: NO PROOF EITHER WAY WITHIN " << hintMillis << " MS (" << searched << ")." << endl;
+            }
+            break;
+        }
+        case OpSolveOptimal: {
+            OptimalSolver solver;
+            solver.setStats(&lastStats);
+            int provenBound;
+            SolveResult result = solver.solve(solitaireGame, provenBound);
+            if (result.status == SolveWin) {
+                msg() << "SHORTEST WIN: " << result.solution.size() << " MOVES (" << result.nodes << " POSITIONS SEARCHED)." << endl;
+                msg() << "PLAY " << encodeSolution(result.solution) << endl;
+            }
+            else if (result.status == SolveLoss) {
+                msg() << "UNWINNABLE (" << result.nodes << " POSITIONS SEARCHED)." << endl;
+            }
+            else {
+                msg() << "UNKNOWN: GAVE UP AFTER " << result.nodes << " POSITIONS; ANY WIN TAKES AT LEAST "
+                    << provenBound << " MOVES." << endl;
+            }
+            break;
+        }
+        case OpPlay: {
+            vector<Move> moves;
+            int delayMs = command.delayMs;
+            if (command.packedMoves != nullptr) {
+                // Compiled: already decoded and cut to N moves
+                for (size_t i = 0; i < command.moveCount; ++i) {
+                    uint32_t word;
+                    memcpy(&word, command.packedMoves + i * sizeof(word), sizeof(word));
+                    moves.push_back(Move::decode(word));
+                }
+            }
+            else if (!parsePlayArguments(command.fileName, command.fileNameLength, moves, delayMs)) {
+                msg() << "Please Give A Valid Move Code: play <code> [N] [ms]" << endl;
+                break;
+            }
+
+            // Rule checks without messages; with a delay, draw each step
+            solitaireGame.setQuiet(true);
+            size_t played = 0;
+            for (; played < moves.size(); ++played) {
+                if (!solitaireGame.applyMove(moves[played])) break;
+                if (delayMs > 0 && !quiet) {
+                    clearScreen();
+                    render();
+                    cout << "PLAYING MOVE " << played + 1 << " OF " << moves.size() << endl;
+                    this_thread::sleep_for(chrono::milliseconds(max(delayMs, 20)));
+                }
+            }
+            solitaireGame.setQuiet(quiet);
+            if (played < moves.size()) {
+                msg() << "MOVE " << played + 1 << " (" << moveToCommand(moves[played]) << ") IS NOT LEGAL HERE; PLAYED "
+                    << played << " MOVE(S)." << endl;
+            }
+            else {
+                msg() << "PLAYED " << played << " MOVE(S)." << endl;
+            }
+            break;
+        }
+        case OpStats: {
+            string fileName(command.fileName, command.fileNameLength);
+            if (lastStats.solver.empty()) {
+                msg() << "NO SEARCH HAS RUN YET; TRY 'solve' OR 'solve optimal' FIRST." << endl;
+                break;
+            }
+            msg() << lastStats.summary() << endl;
+            if (fileName.empty()) {
+                msg() << lastStats.toJson();
+                break;
+            }
+            string json = lastStats.toJson();
+            if (writeFileAtomically(fileName, json.data(), json.size())) {
+                msg() << "STATISTICS WRITTEN TO " << fileName << "." << endl;
+            }
+            else {
+                msg() << "ERROR: COULD NOT WRITE TO " << fileName << "." << endl;
+            }
+            break;
+        }
+        case OpSave: {
+            string fileName(command.fileName, command.fileNameLength);
+            if (fileName.empty()) {
+                msg() << "Please Give A File Name: save <file>" << endl;
+            }
+            else if (solitaireGame.saveToFile(fileName)) {
+                msg() << "GAME SAVED TO " << fileName << "." << endl;
+            }
+            else {
+                msg() << "ERROR: COULD NOT SAVE THE GAME TO " << fileName << "." << endl;
+            }
+            break;
+        }
+        case OpLog: {
+            string fileName(command.fileName, command.fileNameLength);
+            DealIndex deal;
+            if (fileName.empty()) {
+                msg() << "Please Give A File Name: log <file>" << endl;
+            }
+            else if (!solitaireGame.getDealIndex(deal)) {
+                msg() << "THE DEAL OF THIS GAME IS UNKNOWN, SO IT CANNOT BE LOGGED." << endl;
+            }
+            else if (appendGameLog(fileName, deal, solitaireGame.getHistory())) {
+                msg() << "GAME ADDED TO " << fileName << "." << endl;
+            }
+            else {
+                msg() << "ERROR: COULD NOT WRITE TO " << fileName << "." << endl;
+            }
+            break;
+        }
+        case OpLoad: {
+            string fileName(command.fileName, command.fileNameLength);
+            if (fileName.empty()) {
+                msg() << "Please Give A File Name: load <file>" << endl;
+            }
+            else if (solitaireGame.loadFromFile(fileName)) {
+                msg() << "GAME LOADED FROM " << fileName << "." << endl;
+            }
+            else {
+                msg() << "ERROR: " << fileName << " IS NOT A VALID SAVE FILE." << endl;
+            }
+            break;
+        }
+        case OpRun: {
+            string fileName(command.fileName, command.fileNameLength);
+            int executed = runScript(fileName);
+            if (executed < 0) {
+                msg() << "ERROR: COULD NOT RUN SCRIPT " << fileName << "." << endl;
+            }
+            else {
+                msg() << "RAN " << executed << " COMMAND(S) FROM " << fileName << "." << endl;
+            }
+            break;
+        }
+        case OpDeal: {
+            DealIndex index;
+            if (solitaireGame.getDealIndex(index)) {
+                msg() << "DEAL INDEX: " << index.toHex() << endl;
+            }
+            else {
+                msg() << "THE DEAL OF THIS GAME IS UNKNOWN (IT WAS LOADED FROM AN OLDER SAVE FILE)." << endl;
+            }
+            break;
+        }
+        case OpExit:
+            if (!autosavePath.empty()) solitaireGame.saveToFile(autosavePath);
+            msg() << "Exiting Game." << endl;
+            return false;
+        default:
+            msg() << "UNKNOWN COMMAND: " << string(command.word, command.wordLength) << endl;
+            break;
+        }
+
+        // Post-move hook: only after a command that moved a card, so an undo is not
+        // replayed by whatever comes next and hint/save/load see the position as it is
+        bool moverOp = (command.op >= OpDraw && command.op <= OpFoundationToTableau) || command.op == OpPlay;
+        if (autoPlayEnabled && moverOp && solitaireGame.getHistory().getsize() > movesBefore) {
+            solitaireGame.autoPlayToFoundations();
+        }
+        return true;
+    }
+
+    // Run a script without redrawing between commands. Compiled scripts (see
+    // compileScript) are executed straight from their records; text scripts are
+    // parsed line by line in place. Scripts cannot run other scripts. Returns the
+    // number of commands executed, or -1 if the file is unreadable or malformed.
+    int runScript(const string& path) {
+        vector<char> buffer;
+        if (!readWholeFile(path, buffer)) return -1;
+
+        int executed = 0;
+        const char* cursor = buffer.data();
+        const char* end = cursor + buffer.size();
+        ParsedCommand command;
+
+        if (buffer.size() >= 12 && memcmp(cursor, SCRIPT_MAGIC, 4) == 0) {
+            uint16_t version;
+            uint32_t count;
+            memcpy(&version, cursor + 4, sizeof(version));
+            memcpy(&count, cursor + 8, sizeof(count));
+            if (version < 1 || version > SCRIPT_VERSION) return -1;
+            cursor += 12;
+            // Check every record before running any, so a bad file changes nothing
+            vector<ParsedCommand> commands;
+            for (uint32_t i = 0; i < count; ++i) {
+                if (end - cursor < 4) return -1;
+                command = ParsedCommand();
+                command.op = (CommandOp)cursor[0];
+                memcpy(command.args, cursor + 1, 3);
+                cursor += 4;
+                if (command.op >= SCRIPT_OP_END[version]) return -1;
+                if (command.op == OpPlay && version >= 3) {
+                    uint16_t header[2];
+                    if (end - cursor < (ptrdiff_t)sizeof(header)) return -1;
+                    memcpy(header, cursor, sizeof(header));
+                    cursor += sizeof(header);
+                    if ((size_t)(end - cursor) < header[0] * sizeof(uint32_t)) return -1;
+                    command.packedMoves = cursor;
+                    command.moveCount = header[0];
+                    command.delayMs = header[1];
+                    for (size_t move = 0; move < command.moveCount; ++move) {
+                        uint32_t word;
+                        memcpy(&word, cursor, sizeof(word));
+                        cursor += sizeof(word);
+                        if (!isPlayMoveWord(word)) return -1;
+                    }
+                }
+                else if (hasTextPayload(command.op, version)) {
+                    if (cursor >= end || end - cursor - 1 < (unsigned char)*cursor) return -1;
+                    command.fileNameLength = (unsigned char)*cursor++;
+                    command.fileName = cursor;
+                    cursor += command.fileNameLength;
+                }
+                if (command.op != OpRun) commands.push_back(command);
+            }
+            for (const ParsedCommand& record : commands) {
+                executed++;
+                if (!execute(record)) break;
+            }
+            return executed;
+        }
+
+        while (cursor < end) {
+            const char* lineEnd = cursor;
+            while (lineEnd < end && *lineEnd != '\n') ++lineEnd;
+            parseCommand(cursor, lineEnd, command);
+            cursor = lineEnd + 1;
+            if (command.op == OpNone || command.op == OpRun) continue;
+            executed++;
+            if (!execute(command)) break;
+        }
+        return executed;
+    }
+
+    // Redraw the board and report the game status
+    void render() {
+        printInstructions();
+        solitaireGame.printGameState();
 
        
         if (solitaireGame.checkIfNoMoreMoves()) {
@@ -1330,13 +6025,271 @@ public:
         if (solitaireGame.checkIfGameWon()) {
             cout << "Congratulations! You've Won The Game!" << endl;
         }
+        else if (solitaireGame.isEndgameDecided()) {
+            cout << "Every Card Is Face Up. Type 'finish' To Complete The Game." << endl;
+        }
+    }
+
+    // Function to process user commands
+    void processCommand(const string& input) {
+        TRACE_SCOPE("Command::processCommand");
+        clearScreen();  
+
+        ParsedCommand command;
+        parseCommand(input.data(), input.data() + input.size(), command);
+        if (!execute(command)) return;
+
+        if (!autosavePath.empty()) {
+            solitaireGame.saveToFile(autosavePath);
+        }
+
+        render();
+    }
+
+    // Foundation progress of the current game, for replay summaries
+    int foundationCount() const {
+        return solitaireGame.foundationCount();
     }
 };
 
 
-int main() {
+int main(int argc, char* argv[]) {
     Command commandProcessor;
     string input;
+    string resumePath;
+
+    // --resume <file>: restore the session saved in <file> and keep it updated
+    // --batch <first seed> <count> [--agent name|solver] [--threads N] [--out file] [--csv]
+    //         [--checkpoint file]: simulate games and exit, resuming from the checkpoint if it exists
+    //         (seeds are 32-bit unless --deal is given)
+    // --compile <script.txt> <script.bin>: compile a command script and exit
+    // --replay <script>: run a script headless (no output per command) and exit
+    // --deal <hex index>: play the deal with this index; with --batch, number games from it
+    // --solver-memory <MB>: cap on each solver's in-memory visited set; the rest spills to disk
+    // --coordinate <first seed> <count> [--workers N] [--shard-games N] [--socket path] plus the
+    //         --batch options: run the sweep on worker processes (not on Windows)
+    // --worker <socket>: play shards for a coordinator listening on <socket>
+    // --regress [--baseline file] [--write-baseline file] [--threshold percent]: solve the
+    //         reference deals and compare with the expected results and the baseline
+    // --validate <game log> [--threads N] [--out rejects.csv]: replay every logged game and report
+    // --weights <file>: evaluation weights for the heuristic agent and hints, as written by --tune
+    // --hint-ms <ms>: time budget of 'hint', 'hint fair' and 'solve' (default 30)
+    // --hint-latency <first seed> <count>: time a hint on the opening of each deal and report percentiles
+    // --env-check <first seed> <count>: step the training environment against the game rules
+    // --tune <iterations> <games> [--threads N] [--weights file]: tune the evaluation weights on
+    //         self-play, starting from --weights if it exists, and save the best set there
+    bool batch = false;
+    string compileIn, compileOut, replayPath;
+    bool hasDeal = false;
+    DealIndex dealIndex;
+    string agentName = "greedy";
+    uint64_t firstSeed = 0, count = 0;
+    int threads = (int)thread::hardware_concurrency();
+    string outPath;
+    string checkpointPath;
+    bool coordinate = false;
+    int workers = 4;
+    uint64_t shardGames = 0;
+    string socketPath, workerSocket;
+    string validatePath;
+    bool regress = false;
+    string baselinePath, writeBaselinePath;
+    double threshold = 10;
+    int tuneIterations = 0, tuneGames = 0;
+    bool hintLatency = false;
+    bool envCheck = false;
+    bool csv = false;
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "--resume") {
+            resumePath = i + 1 < argc ? argv[++i] : "solitaire.sav";
+        }
+        else if (arg == "--batch" && i + 2 < argc) {
+            batch = true;
+            firstSeed = strtoull(argv[++i], nullptr, 10);
+            count = strtoull(argv[++i], nullptr, 10);
+        }
+        else if (arg == "--agent" && i + 1 < argc) {
+            agentName = argv[++i];
+        }
+        else if (arg == "--threads" && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+        }
+        else if (arg == "--out" && i + 1 < argc) {
+            outPath = argv[++i];
+        }
+        else if (arg == "--coordinate" && i + 2 < argc) {
+            coordinate = true;
+            firstSeed = strtoull(argv[++i], nullptr, 10);
+            count = strtoull(argv[++i], nullptr, 10);
+        }
+        else if (arg == "--workers" && i + 1 < argc) {
+            workers = max(1, atoi(argv[++i]));
+        }
+        else if (arg == "--shard-games" && i + 1 < argc) {
+            shardGames = max(1ULL, strtoull(argv[++i], nullptr, 10));
+        }
+        else if (arg == "--socket" && i + 1 < argc) {
+            socketPath = argv[++i];
+        }
+        else if (arg == "--regress") {
+            regress = true;
+        }
+        else if (arg == "--baseline" && i + 1 < argc) {
+            baselinePath = argv[++i];
+        }
+        else if (arg == "--write-baseline" && i + 1 < argc) {
+            writeBaselinePath = argv[++i];
+        }
+        else if (arg == "--threshold" && i + 1 < argc) {
+            threshold = atof(argv[++i]);
+        }
+        else if (arg == "--validate" && i + 1 < argc) {
+            validatePath = argv[++i];
+        }
+        else if (arg == "--worker" && i + 1 < argc) {
+            workerSocket = argv[++i];
+        }
+        else if (arg == "--hint-ms" && i + 1 < argc) {
+            hintMillis = max(1, atoi(argv[++i]));
+        }
+        else if (arg == "--hint-latency" && i + 2 < argc) {
+            hintLatency = true;
+            firstSeed = strtoull(argv[++i], nullptr, 10);
+            count = strtoull(argv[++i], nullptr, 10);
+        }
+        else if (arg == "--env-check" && i + 2 < argc) {
+            envCheck = true;
+            firstSeed = strtoull(argv[++i], nullptr, 10);
+            count = strtoull(argv[++i], nullptr, 10);
+        }
+        else if (arg == "--weights" && i + 1 < argc) {
+            evalWeightsPath = argv[++i];
+        }
+        else if (arg == "--tune" && i + 2 < argc) {
+            tuneIterations = max(1, atoi(argv[++i]));
+            tuneGames = max(1, atoi(argv[++i]));
+        }
+        else if (arg == "--checkpoint" && i + 1 < argc) {
+            checkpointPath = argv[++i];
+        }
+        else if (arg == "--csv") {
+            csv = true;
+        }
+        else if (arg == "--compile" && i + 2 < argc) {
+            compileIn = argv[++i];
+            compileOut = argv[++i];
+        }
+        else if (arg == "--replay" && i + 1 < argc) {
+            replayPath = argv[++i];
+        }
+        else if (arg == "--solver-memory" && i + 1 < argc) {
+            solverMemoryCap = (size_t)max(1, atoi(argv[++i])) << 20;
+        }
+        else if (arg == "--deal" && i + 1 < argc) {
+            if (!DealIndex::fromHex(argv[++i], dealIndex) || !(dealIndex < DEAL_COUNT)) {
+                cout << "ERROR: " << argv[i] << " IS NOT A VALID DEAL INDEX." << endl;
+                return 1;
+            }
+            hasDeal = true;
+        }
+    }
+    if (threads < 1) threads = 1;
+
+    // Seeds feed the 32-bit deal generator; larger ones would silently repeat deals.
+    // With --deal they are offsets into the deal numbering, which is wide enough.
+    bool seededDeals = hintLatency || envCheck || ((batch || coordinate) && !hasDeal);
+    if (seededDeals && count > 0 && (firstSeed > 0xFFFFFFFFULL || count - 1 > 0xFFFFFFFFULL - firstSeed)) {
+        cout << "ERROR: SEEDS MUST BE AT MOST 4294967295; USE --deal FOR LARGER DEAL NUMBERS." << endl;
+        return 1;
+    }
+
+    // A tuning run may start without a weights file and create it
+    bool newWeightsFile = tuneIterations > 0 && !filesystem::exists(evalWeightsPath);
+    if (!evalWeightsPath.empty() && !newWeightsFile && !loadWeights(evalWeightsPath, evalWeights)) {
+        cout << "ERROR: " << evalWeightsPath << " IS NOT A VALID WEIGHTS FILE." << endl;
+        return 1;
+    }
+
+    if (tuneIterations > 0) {
+        runTuning(tuneIterations, tuneGames, threads, evalWeightsPath.empty() ? "weights.txt" : evalWeightsPath);
+        TRACE_WRITE();
+        return 0;
+    }
+
+    if (hintLatency) {
+        runHintLatency(firstSeed, count);
+        TRACE_WRITE();
+        return 0;
+    }
+
+    if (envCheck) {
+        bool passed = runEnvCheck(firstSeed, (int)min(count, (uint64_t)100000), 300);
+        TRACE_WRITE();
+        return passed ? 0 : 1;
+    }
+
+    if (regress) {
+        bool passed = runRegression(baselinePath, writeBaselinePath, threshold);
+        TRACE_WRITE();
+        return passed ? 0 : 1;
+    }
+
+    if (!validatePath.empty()) {
+        runValidation(validatePath, threads, outPath);
+        TRACE_WRITE();
+        return 0;
+    }
+
+    if (coordinate || !workerSocket.empty()) {
+#ifndef _WIN32
+        if (!workerSocket.empty()) return runWorker(workerSocket);
+        if (shardGames == 0) shardGames = batchChunkGames(agentName == "solver");
+        if (socketPath.empty()) socketPath = "/tmp/solitaire-" + to_string(getpid()) + ".sock";
+        runCoordinator(argv[0], firstSeed, count, workers, shardGames, agentName, outPath, csv,
+            hasDeal ? &dealIndex : nullptr, socketPath);
+#else
+        cout << "ERROR: WORKER PROCESSES ARE NOT SUPPORTED ON WINDOWS; USE --batch WITH --threads." << endl;
+#endif
+        TRACE_WRITE();
+        return 0;
+    }
+
+    if (batch) {
+        runBatch(firstSeed, count, threads, agentName, outPath, csv, hasDeal ? &dealIndex : nullptr, checkpointPath);
+        TRACE_WRITE();
+        return 0;
+    }
+
+    if (hasDeal) {
+        commandProcessor.newGame(dealIndex);
+    }
+
+    if (!compileIn.empty()) {
+        string error;
+        int compiled = compileScript(compileIn, compileOut, error);
+        if (compiled < 0) {
+            cout << "ERROR: " << error << endl;
+            return 1;
+        }
+        cout << "COMPILED " << compiled << " COMMANDS INTO " << compileOut << "." << endl;
+        return 0;
+    }
+
+    if (!replayPath.empty()) {
+        commandProcessor.setQuiet(true);
+        auto start = chrono::steady_clock::now();
+        int executed = commandProcessor.runScript(replayPath);
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        if (executed < 0) {
+            cout << "ERROR: COULD NOT RUN SCRIPT " << replayPath << "." << endl;
+            return 1;
+        }
+        cout << "REPLAYED " << executed << " COMMANDS IN " << seconds << " SECONDS; "
+            << commandProcessor.foundationCount() << " CARDS ON THE FOUNDATIONS." << endl;
+        TRACE_WRITE();
+        return 0;
+    }
 
     // Show the main screen with ASCII art
     displayMainScreen();
@@ -1347,10 +6300,14 @@ int main() {
 
     system("CLS");
 
+    if (!resumePath.empty()) {
+        commandProcessor.resume(resumePath);
+    }
+
     // Main game loop
     while (true) {
         
-        cout << "Enter command (s, m, w2t, t2f, w2f, f2t, z, exit): ";
+        cout << "Enter command (s, m, w2t, t2f, w2f, f2t, z, auto, finish, analyze, hint, solve, play, stats, save, load, log, run, deal, exit): ";
         getline(cin, input); 
 
     
@@ -1363,5 +6320,7 @@ int main() {
         }
     }
 
+    TRACE_WRITE();
+
     return 0;
 }   
\ No newline at end of file